@@ -0,0 +1,226 @@
+// producer to consumer throughput across cores, one producer and one
+// consumer and then two of each, for the ring as it was before its
+// positions got lines of their own and were masked rather than divided,
+// for mpmc_ring as it is now and for channel<T> on top of it. every
+// thread is pinned to a core of its own when there are enough of them;
+// on a single core the layouts come out alike
+//
+//   g++ -std=c++17 -O2 -pthread -I../ipc ../ipc/*.cpp rings.cpp -o rings
+
+#include "ipc.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+	const int values = 2000000;
+
+	// what the consumers received, so the loops are not optimized away
+	std::atomic_long received(0);
+
+	typedef std::chrono::steady_clock clock;
+
+	// the mpmc ring before: both positions on one line, next to the
+	// buffer pointer and size, and a position mapped to its cell with a
+	// division by a size that need not be a power of two
+	class packed_ring
+	{
+		struct cell
+		{
+			std::atomic_size_t seq;
+			int data;
+		};
+
+		std::unique_ptr<cell[]> buffer_;
+		std::size_t capacity_;
+		std::atomic_size_t enqueue_pos_;
+		std::atomic_size_t dequeue_pos_;
+	public:
+		packed_ring(std::size_t size);
+	public:
+		bool try_push(const int& data);
+		bool try_pop(int& data);
+	};
+
+	packed_ring::packed_ring(std::size_t size)
+		: buffer_(new cell[size])
+		, capacity_(size)
+		, enqueue_pos_(0)
+		, dequeue_pos_(0)
+	{
+		for (std::size_t i = 0; i < capacity_; i++)
+			buffer_[i].seq.store(2 * i, std::memory_order_relaxed);
+	}
+
+	bool packed_ring::try_push(const int& data)
+	{
+		cell* c;
+		std::size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+		while (true)
+		{
+			c = &buffer_[pos % capacity_];
+			std::size_t seq = c->seq.load(std::memory_order_acquire);
+			std::ptrdiff_t dif = static_cast<std::ptrdiff_t>(seq - 2 * pos);
+			if (dif == 0)
+			{
+				if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+						std::memory_order_relaxed))
+					break;
+			}
+			else if (dif < 0)
+				return false;
+			else
+				pos = enqueue_pos_.load(std::memory_order_relaxed);
+		}
+		c->data = data;
+		c->seq.store(2 * pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool packed_ring::try_pop(int& data)
+	{
+		cell* c;
+		std::size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+		while (true)
+		{
+			c = &buffer_[pos % capacity_];
+			std::size_t seq = c->seq.load(std::memory_order_acquire);
+			std::ptrdiff_t dif = static_cast<std::ptrdiff_t>(seq - (2 * pos + 1));
+			if (dif == 0)
+			{
+				if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+						std::memory_order_relaxed))
+					break;
+			}
+			else if (dif < 0)
+				return false;
+			else
+				pos = dequeue_pos_.load(std::memory_order_relaxed);
+		}
+		data = c->data;
+		c->seq.store(2 * (pos + capacity_), std::memory_order_release);
+		return true;
+	}
+
+	void pin(const unsigned& core)
+	{
+#if defined(__linux__)
+		unsigned cores = std::thread::hardware_concurrency();
+		if (cores < 2)
+			return;
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(core % cores, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+	}
+
+	// a ring is polled, yielding while it is full or empty, so that the
+	// time is the ring's own and not a wake's
+	template <class Ring>
+	struct polled
+	{
+		Ring ring;
+
+		polled(const std::size_t& size)
+			: ring(size)
+		{
+		}
+
+		void send(const int& data)
+		{
+			while (!ring.try_push(data))
+				std::this_thread::yield();
+		}
+
+		int recv(void)
+		{
+			int data;
+			while (!ring.try_pop(data))
+				std::this_thread::yield();
+			return data;
+		}
+	};
+
+	struct blocking
+	{
+		ipc::channel<int> ch;
+
+		blocking(const std::size_t& size)
+			: ch(static_cast<int>(size))
+		{
+		}
+
+		void send(const int& data)
+		{
+			ch.send(data);
+		}
+
+		int recv(void)
+		{
+			return ch.recv().data;
+		}
+	};
+
+	// pairs producers and as many consumers move values between them,
+	// every one on a core of its own; ns per value
+	template <class Queue>
+	double run(const std::size_t& size, const int& pairs)
+	{
+		Queue q(size);
+		std::atomic_int ready(0);
+		std::atomic_bool go(false);
+		std::vector<std::thread> threads;
+		int each = values / pairs;
+		for (int i = 0; i < 2 * pairs; i++)
+			threads.emplace_back([&, i](void) {
+				pin(i);
+				ready++;
+				while (!go)
+					std::this_thread::yield();
+				long sum = 0;
+				for (int n = 0; n < each; n++)
+					if (i % 2 == 0)
+						q.send(n);
+					else
+						sum += q.recv();
+				received += sum;
+			});
+		while (ready != 2 * pairs)
+			std::this_thread::yield();
+		clock::time_point t0 = clock::now();
+		go = true;
+		for (auto& t: threads)
+			t.join();
+		return std::chrono::duration<double, std::nano>(
+			clock::now() - t0).count() / (each * pairs);
+	}
+
+	void row(const std::size_t& size, const int& pairs)
+	{
+		std::printf("%6zu %6dx%d %12.1f %12.1f %12.1f\n", size, pairs, pairs,
+			run<polled<packed_ring>>(size, pairs),
+			run<polled<ipc::mpmc_ring<int>>>(size, pairs),
+			run<blocking>(size, pairs));
+	}
+}
+
+int main(void)
+{
+	std::printf("%6s %8s %12s %12s %12s\n",
+		"size", "threads", "before ns", "ring ns", "channel ns");
+	for (int pairs = 1; pairs <= 2; pairs++)
+		for (std::size_t size: { 8, 1000 })
+			row(size, pairs);
+	return 0;
+}
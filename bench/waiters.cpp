@@ -0,0 +1,70 @@
+// how the cost of waking and of cancelling a waiter grows with the
+// number of waiters parked on one channel; with the intrusive wait
+// queues both should stay flat from 1 to 10k. the waiters are fibers so
+// that 10k of them are cheap to park
+//
+//   g++ -std=c++17 -O2 -pthread -I../ipc ../ipc/*.cpp waiters.cpp -o waiters
+
+#include "ipc.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+namespace
+{
+	const int sends = 20000;
+	const int cancels = 20000;
+
+	typedef std::chrono::steady_clock clock;
+
+	double ns_per(const clock::duration& d, const int& n)
+	{
+		return std::chrono::duration<double, std::nano>(d).count() / n;
+	}
+
+	// waiters receivers park on ch and go back to it after every value,
+	// so the queue stays about that long; a negative value ends them
+	void run(const int& waiters)
+	{
+		ipc::runtime rt(1, 16 * 1024);
+		ipc::channel<int> ch;
+		std::atomic_int started(0);
+		for (int i = 0; i < waiters; i++)
+			rt.go([&ch, &started](void) {
+				started++;
+				while (ch.recv().data >= 0)
+					;
+			});
+		while (started != waiters)
+			std::this_thread::yield();
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+		// a timed receive that runs out is a node linked at the back of
+		// the queue and unlinked again
+		clock::time_point t0 = clock::now();
+		for (int i = 0; i < cancels; i++)
+			ch.recv_until(clock::time_point());
+		double cancel = ns_per(clock::now() - t0, cancels);
+
+		// every send takes the waiter at the front
+		t0 = clock::now();
+		for (int i = 0; i < sends; i++)
+			ch.send(i);
+		double send = ns_per(clock::now() - t0, sends);
+
+		for (int i = 0; i < waiters; i++)
+			ch.send(-1);
+		rt.wait();
+		std::printf("%8d %12.0f %12.0f\n", waiters, send, cancel);
+	}
+}
+
+int main(void)
+{
+	std::printf("%8s %12s %12s\n", "waiters", "send ns", "cancel ns");
+	for (int waiters = 1; waiters <= 10000; waiters *= 10)
+		run(waiters);
+	return 0;
+}
@@ -0,0 +1,134 @@
+#include "ipc.async.h"
+
+#if defined(__cpp_impl_coroutine)
+
+#include <stdexcept>
+
+// phase_ tells whether the coroutine has been handed over yet: a signal
+// that comes while the cases are still being armed is left for arm to
+// pick up, only one that comes later posts the coroutine
+namespace
+{
+	const int arming = 0;
+	const int parked = 1;
+	const int signalled = 2;
+}
+
+ipc::async_context::async_context(void)
+	: cases_(nullptr)
+	, n_(0)
+	, order_(nullptr)
+	, norder_(0)
+	, block_(true)
+	, sched_(nullptr)
+	, phase_(arming)
+	, index_(-1)
+{
+}
+
+// returns true when the coroutine stays suspended, false when a case
+// went ahead, or nothing was ready and block is false, without waiting
+bool ipc::async_context::suspend(std::coroutine_handle<> handle,
+	const ipc::scase* cases, const std::size_t& n,
+	ipc::channable* const* order, const std::size_t& norder,
+	const bool& block)
+{
+	sched_ = scheduler::current();
+	if (sched_ == nullptr && block)
+		throw std::logic_error("co_await on a channel outside a scheduler");
+	handle_ = handle;
+	cases_ = cases;
+	n_ = n;
+	order_ = order;
+	norder_ = norder;
+	block_ = block;
+	for (std::size_t i = 0; i < n; i++)
+		add(cases[i].chan, cases[i].data, cases[i].recv);
+	sellock(order_, norder_);
+	return arm();
+}
+
+// the index of the case that went ahead, or -1 for none; rethrows what
+// the wait ended with
+int ipc::async_context::index(void) const
+{
+	if (error_)
+		std::rethrow_exception(error_);
+	return index_;
+}
+
+void ipc::async_context::signal(void)
+{
+	if (phase_.exchange(signalled) == parked)
+		sched_->post([this](void) { step(); });
+}
+
+// with every channel locked and no node linked, polls the cases and
+// parks on all of them when none is ready; true when parked. once the
+// phase says parked the coroutine may already be running elsewhere, so
+// nothing of it is touched after that
+bool ipc::async_context::arm(void)
+{
+	while (true)
+	{
+		int i;
+		try
+		{
+			i = selpoll(this, cases_, n_);
+		}
+		catch (...)
+		{
+			selunlock(order_, norder_);
+			clear();
+			throw;
+		}
+		if (i != -1 || !block_)
+		{
+			selunlock(order_, norder_);
+			clear();
+			index_ = i;
+			return false;
+		}
+		phase_ = arming;
+		add_to_all_channels();
+		selunlock(order_, norder_);
+		if (phase_.exchange(parked) != signalled)
+			return true;
+		if (wake())
+			return false;
+	}
+}
+
+// once claimed: true with the nodes unlinked when a case fired, false
+// with every channel locked again and the nodes unlinked on a retry
+bool ipc::async_context::wake(void)
+{
+	int index = get_unblocked_index();
+	if (index != -1)
+	{
+		remove_from_all_channels(true);
+		clear();
+		index_ = index;
+		return true;
+	}
+	sellock(order_, norder_);
+	remove_from_all_channels();
+	rearm();
+	return false;
+}
+
+void ipc::async_context::step(void)
+{
+	try
+	{
+		if (!wake() && arm())
+			return;
+	}
+	catch (...)
+	{
+		error_ = std::current_exception();
+	}
+	handle_.resume();
+}
+
+#endif
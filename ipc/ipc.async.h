@@ -0,0 +1,267 @@
+#ifndef __IPC_ASYNC__
+#define __IPC_ASYNC__
+
+#if defined(__cpp_impl_coroutine)
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+
+#include "ipc.select.h"
+#include "ipc.scheduler.h"
+
+namespace ipc
+{
+	// the context a suspended coroutine parks in the channels' queues in
+	// place of a thread: its signal posts the rest of the wait to the
+	// scheduler the coroutine runs on, which finishes it and resumes the
+	// coroutine. it goes through the same poll and enqueue as select, so
+	// channels see no difference between the two. a coroutine parked in
+	// a channel must not be destroyed before it has been resumed
+	class async_context : public context
+	{
+		const scase* cases_;
+		std::size_t n_;
+		channable* const* order_;
+		std::size_t norder_;
+		bool block_;
+
+		scheduler* sched_;
+		std::coroutine_handle<> handle_;
+		std::atomic_int phase_;
+
+		int index_;
+		std::exception_ptr error_;
+	public:
+		async_context(void);
+	public:
+		bool suspend(std::coroutine_handle<> handle, const scase* cases,
+			const std::size_t& n, channable* const* order,
+			const std::size_t& norder, const bool& block);
+		int index(void) const;
+	public:
+		virtual void signal(void);
+	private:
+		bool arm(void);
+		bool wake(void);
+		void step(void);
+	};
+
+	// co_await ch.async_recv() gives the same result<T> as ch.recv()
+	template <class Chan>
+	class recv_awaitable
+	{
+		typedef channel_value<Chan> T;
+
+		Chan* chan_;
+		slot<T> storage_;
+		bool ready_;
+		scase case_;
+		channable* order_[1];
+		async_context ctext_;
+	public:
+		recv_awaitable(Chan& chan);
+		~recv_awaitable(void);
+	public:
+		bool await_ready(void);
+		bool await_suspend(std::coroutine_handle<> handle);
+		result<T> await_resume(void);
+	};
+
+	template <class Chan>
+	recv_awaitable<Chan>::recv_awaitable(Chan& chan)
+		: chan_(&chan)
+		, ready_(false)
+	{
+	}
+
+	template <class Chan>
+	recv_awaitable<Chan>::~recv_awaitable(void)
+	{
+		if (ready_)
+			reinterpret_cast<T*>(&storage_)->~T();
+	}
+
+	// a value that can be had without waiting is taken on the spot
+	template <class Chan>
+	bool recv_awaitable<Chan>::await_ready(void)
+	{
+		result<T> res = chan_->recv(false);
+		if (res.ok)
+		{
+			new (&storage_) T(std::move(res.data));
+			ready_ = true;
+		}
+		return res.ok;
+	}
+
+	template <class Chan>
+	bool recv_awaitable<Chan>::await_suspend(std::coroutine_handle<> handle)
+	{
+		case_ = scase{ chan_, &storage_, true };
+		order_[0] = chan_;
+		return ctext_.suspend(handle, &case_, 1, order_, 1, true);
+	}
+
+	template <class Chan>
+	result<channel_value<Chan>> recv_awaitable<Chan>::await_resume(void)
+	{
+		if (!ready_)
+		{
+			ctext_.index();
+			ready_ = true;
+		}
+		T* pd = reinterpret_cast<T*>(&storage_);
+		result<T> res(std::move(*pd), true);
+		pd->~T();
+		ready_ = false;
+		return res;
+	}
+
+	// co_await ch.async_send(v) returns once v went through, or throws as
+	// send does when the channel is closed
+	template <class Chan>
+	class send_awaitable
+	{
+		typedef channel_value<Chan> T;
+
+		Chan* chan_;
+		T data_;
+		scase case_;
+		channable* order_[1];
+		async_context ctext_;
+	public:
+		template <class U>
+		send_awaitable(Chan& chan, U&& data);
+	public:
+		bool await_ready(void);
+		bool await_suspend(std::coroutine_handle<> handle);
+		void await_resume(void);
+	};
+
+	template <class Chan>
+	template <class U>
+	send_awaitable<Chan>::send_awaitable(Chan& chan, U&& data)
+		: chan_(&chan)
+		, data_(std::forward<U>(data))
+	{
+	}
+
+	// a failed non blocking send leaves the value with us
+	template <class Chan>
+	bool send_awaitable<Chan>::await_ready(void)
+	{
+		return chan_->send(std::move(data_), false);
+	}
+
+	template <class Chan>
+	bool send_awaitable<Chan>::await_suspend(std::coroutine_handle<> handle)
+	{
+		case_ = scase{ chan_, &data_, false };
+		order_[0] = chan_;
+		return ctext_.suspend(handle, &case_, 1, order_, 1, true);
+	}
+
+	template <class Chan>
+	void send_awaitable<Chan>::await_resume(void)
+	{
+		ctext_.index();
+	}
+
+	// co_await async_select(cases...) runs the handler of the case that
+	// went ahead, or of the default case, and returns its index as select
+	// does; the cases are kept in the coroutine frame while it waits
+	template <class... Cases>
+	class select_awaitable
+	{
+		static constexpr std::size_t n = sizeof...(Cases);
+
+		std::tuple<Cases...> cases_;
+		scase sc_[n];
+		channable* order_[n];
+		async_context ctext_;
+	public:
+		template <class... Args>
+		select_awaitable(Args&&... cases);
+	public:
+		bool await_ready(void);
+		bool await_suspend(std::coroutine_handle<> handle);
+		int await_resume(void);
+	};
+
+	template <class... Cases>
+	template <class... Args>
+	select_awaitable<Cases...>::select_awaitable(Args&&... cases)
+		: cases_(std::forward<Args>(cases)...)
+	{
+	}
+
+	template <class... Cases>
+	bool select_awaitable<Cases...>::await_ready(void)
+	{
+		return false;
+	}
+
+	template <class... Cases>
+	bool select_awaitable<Cases...>::await_suspend(
+		std::coroutine_handle<> handle)
+	{
+		std::apply([this](Cases&... cases) {
+			std::size_t i = 0;
+			((sc_[i++] = cases.get()), ...);
+		}, cases_);
+		std::size_t norder = lockorder(sc_, n, order_);
+		return ctext_.suspend(handle, sc_, n, order_, norder,
+			count_defaults<Cases...>::value == 0);
+	}
+
+	template <class... Cases>
+	int select_awaitable<Cases...>::await_resume(void)
+	{
+		int index = ctext_.index();
+		std::apply([&index](Cases&... cases) {
+			int i = 0;
+			((index == -1 ? (Cases::is_default ? (index = i, cases.fire()) :
+				void()) : (i == index ? cases.fire() : void()), i++), ...);
+		}, cases_);
+		return index;
+	}
+
+	template <class... Cases>
+	select_awaitable<typename std::decay<Cases>::type...> async_select(
+		Cases&&... cases)
+	{
+		static_assert(sizeof...(Cases) > 0, "select needs at least one case");
+		static_assert(count_defaults<Cases...>::value <= 1,
+			"select takes at most one default case");
+		return select_awaitable<typename std::decay<Cases>::type...>(
+			std::forward<Cases>(cases)...);
+	}
+
+	template <class T, class Ring>
+	recv_awaitable<basic_channel<T, Ring>> basic_channel<T, Ring>::async_recv(void)
+	{
+		return recv_awaitable<basic_channel>(*this);
+	}
+
+	template <class T, class Ring>
+	send_awaitable<basic_channel<T, Ring>> basic_channel<T, Ring>::async_send(
+		const T& data)
+	{
+		return send_awaitable<basic_channel>(*this, data);
+	}
+
+	template <class T, class Ring>
+	send_awaitable<basic_channel<T, Ring>> basic_channel<T, Ring>::async_send(
+		T&& data)
+	{
+		return send_awaitable<basic_channel>(*this, std::move(data));
+	}
+}
+
+#endif
+
+#endif
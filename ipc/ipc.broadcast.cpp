@@ -0,0 +1,12 @@
+#include "ipc.broadcast.h"
+
+ipc::lag_error::lag_error(const std::uint64_t& missed)
+	: std::runtime_error("subscription lagged behind its broadcast channel")
+	, missed_(missed)
+{
+}
+
+std::uint64_t ipc::lag_error::missed(void) const
+{
+	return missed_;
+}
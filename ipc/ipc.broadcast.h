@@ -0,0 +1,569 @@
+#ifndef __IPC_BROADCAST__
+#define __IPC_BROADCAST__
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <utility>
+#include <stdexcept>
+#include <chrono>
+#include <cstdint>
+
+#include "ipc.channel.h"
+#include "ipc.noncopyable.h"
+
+namespace ipc
+{
+	// what a broadcast channel does once its slowest subscription is a
+	// whole ring behind: block the sender, or write over the oldest value
+	// and have the subscription skip it, silently with drop_oldest and
+	// through lag_error with error
+	enum class lag_policy { block, drop_oldest, error };
+
+	// thrown by recv on a subscription that lost values under
+	// lag_policy::error; it has already moved on to the oldest value
+	// still held, which the next recv returns
+	class lag_error : public std::runtime_error
+	{
+		std::uint64_t missed_;
+	public:
+		lag_error(const std::uint64_t& missed);
+	public:
+		std::uint64_t missed(void) const;
+	};
+
+	template <class T>
+	class subscription;
+
+	// a channel whose every value goes to every subscription: a value is
+	// written once into a shared ring and each subscription copies it out
+	// at its own cursor, so fanning out to n receivers is one send rather
+	// than n. a subscription sees what was sent after it was made. the
+	// ring holds size values, rounded up to a power of two, and policy
+	// says what a sender does when the slowest subscription falls that
+	// far behind; with no subscription a value goes nowhere. every
+	// subscription must go before the channel does
+	template <class T>
+	class broadcast_channel : public noncopyable
+	{
+		std::unique_ptr<slot<T>[]> buffer_;
+		std::size_t capacity_;
+		std::size_t mask_;
+		lag_policy policy_;
+
+		std::atomic<std::uint64_t> head_;
+		std::atomic_bool closed_;
+
+		// held by a send throughout and guards the subscription list
+		std::mutex mutex_;
+		std::vector<subscription<T>*> subs_;
+
+		// guards the parked senders, and the values in the ring when a
+		// send may write over one a subscription is still copying; under
+		// lag_policy::block it never can, and the values go without it.
+		// taken after a subscription's lock, never before it
+		std::mutex ring_mutex_;
+		waitq sendq_;
+		std::atomic_size_t sendw_;
+	public:
+		typedef T value_type;
+	public:
+		broadcast_channel(const std::size_t& size,
+			const lag_policy& policy = lag_policy::block);
+		virtual ~broadcast_channel(void);
+	public:
+		std::size_t capacity(void) const;
+	public:
+		bool send(const T& data, const bool& block = true);
+		bool send(T&& data, const bool& block = true);
+	public:
+		void close(void);
+	private:
+		friend class subscription<T>;
+	private:
+		bool publish(T& data, const bool& block);
+		bool room(void) const;
+		void write(T& data);
+		void wake_senders(void);
+	private:
+		void subscribe(subscription<T>* sub);
+		void unsubscribe(subscription<T>* sub);
+	};
+
+	// receives from a broadcast channel at a cursor of its own; to select
+	// and selector it is a channel that can only be received from
+	template <class T>
+	class subscription : public channable, public noncopyable
+	{
+		broadcast_channel<T>* chan_;
+		std::atomic<std::uint64_t> cursor_;
+
+		std::atomic_size_t recvw_;
+		std::mutex mutex_;
+		waitq recvq_;
+	public:
+		typedef T value_type;
+	public:
+		subscription(broadcast_channel<T>& chan);
+		virtual ~subscription(void);
+	public:
+		std::size_t size(void) const;
+		bool empty(void) const;
+	public:
+		result<T> recv(const bool& block = true);
+		result<T> recv_until(
+			const std::chrono::steady_clock::time_point& deadline);
+		result<T> recv_for(const std::chrono::steady_clock::duration& timeout);
+	public:
+		void add_sender(waiter* w);
+		void add_receiver(waiter* w);
+	public:
+		bool remove_sender(waiter* w);
+		bool remove_receiver(waiter* w);
+	public:
+		void lock(void);
+		void unlock(void);
+	public:
+		bool peek(void* data);
+		bool poke(void* data);
+	private:
+		friend class broadcast_channel<T>;
+	private:
+		result<T> receive(const bool& block,
+			std::unique_lock<std::mutex>& lock,
+			const std::chrono::steady_clock::time_point* deadline = nullptr);
+		int take(void* data, const bool& report);
+		bool ready(void) const;
+		void unblock(void);
+	};
+
+	template <class T>
+	broadcast_channel<T>::broadcast_channel(const std::size_t& size,
+		const lag_policy& policy)
+		: buffer_(new slot<T>[ceil_pow2(size == 0 ? 1 : size)])
+		, capacity_(ceil_pow2(size == 0 ? 1 : size))
+		, mask_(capacity_ - 1)
+		, policy_(policy)
+		, head_(0)
+		, closed_(false)
+		, sendw_(0)
+	{
+	}
+
+	// the slots below head, up to a whole ring, hold a value
+	template <class T>
+	broadcast_channel<T>::~broadcast_channel(void)
+	{
+		std::uint64_t n = std::min<std::uint64_t>(head_, capacity_);
+		for (std::uint64_t i = 0; i < n; i++)
+			reinterpret_cast<T*>(&buffer_[i])->~T();
+	}
+
+	template <class T>
+	std::size_t broadcast_channel<T>::capacity(void) const
+	{
+		return capacity_;
+	}
+
+	template <class T>
+	bool broadcast_channel<T>::send(const T& data, const bool& block)
+	{
+		T copy(data);
+		return publish(copy, block);
+	}
+
+	// a send that does not block and finds no room leaves a value that
+	// was moved in with the caller
+	template <class T>
+	bool broadcast_channel<T>::send(T&& data, const bool& block)
+	{
+		return publish(data, block);
+	}
+
+	// parked senders throw, subscriptions get what is left and then
+	// see the channel closed
+	template <class T>
+	void broadcast_channel<T>::close(void)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (closed_)
+			return;
+		closed_ = true;
+		wake_senders();
+		for (auto s: subs_)
+		{
+			std::lock_guard<std::mutex> sub_lock(s->mutex_);
+			s->unblock();
+		}
+	}
+
+	// a sender parks like one on a full channel, on the wake of a
+	// subscription that moved on; the fence pairs with the one after a
+	// subscription moves its cursor
+	template <class T>
+	bool broadcast_channel<T>::publish(T& data, const bool& block)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		while (true)
+		{
+			if (closed_)
+				throw std::runtime_error("send on closed channel");
+			if (room())
+				break;
+			if (!block)
+				return false;
+			context* ctext = context::get();
+			waiter* w = ctext->add(nullptr, &data);
+			{
+				std::lock_guard<std::mutex> ring_lock(ring_mutex_);
+				sendq_.push_back(w);
+				sendw_ = sendq_.size();
+			}
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			bool wait = true;
+			if (room() || closed_)
+			{
+				std::lock_guard<std::mutex> ring_lock(ring_mutex_);
+				wait = !sendq_.remove(w);
+				sendw_ = sendq_.size();
+			}
+			lock.unlock();
+			if (wait)
+				ctext->wait();
+			ctext->clear();
+			lock.lock();
+		}
+		write(data);
+		return true;
+	}
+
+	// called with the lock held
+	template <class T>
+	bool broadcast_channel<T>::room(void) const
+	{
+		if (policy_ != lag_policy::block)
+			return true;
+		std::uint64_t head = head_.load(std::memory_order_relaxed);
+		for (auto s: subs_)
+			if (head - s->cursor_.load(std::memory_order_acquire) >= capacity_)
+				return false;
+		return true;
+	}
+
+	// called with the lock held; the fence pairs with the one in
+	// subscription::add_receiver, so that either a parked receiver sees
+	// the new head or we see it waiting. under lag_policy::block room has
+	// seen every cursor past the slot, so no subscription is reading it
+	template <class T>
+	void broadcast_channel<T>::write(T& data)
+	{
+		{
+			std::unique_lock<std::mutex> ring_lock(ring_mutex_, std::defer_lock);
+			if (policy_ != lag_policy::block)
+				ring_lock.lock();
+			std::uint64_t head = head_.load(std::memory_order_relaxed);
+			T* p = reinterpret_cast<T*>(&buffer_[head & mask_]);
+			if (head < capacity_)
+				new (p) T(std::move(data));
+			else
+				*p = std::move(data);
+			head_.store(head + 1, std::memory_order_release);
+		}
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		for (auto s: subs_)
+		{
+			if (s->recvw_.load(std::memory_order_relaxed) == 0)
+				continue;
+			std::lock_guard<std::mutex> sub_lock(s->mutex_);
+			s->unblock();
+		}
+	}
+
+	// every parked sender looks again, as which subscription is the
+	// slowest is not known here
+	template <class T>
+	void broadcast_channel<T>::wake_senders(void)
+	{
+		std::lock_guard<std::mutex> ring_lock(ring_mutex_);
+		while (waiter* w = sendq_.pop_front())
+			if (w->ctext->claim())
+				w->ctext->signal();
+		sendw_ = 0;
+	}
+
+	template <class T>
+	void broadcast_channel<T>::subscribe(subscription<T>* sub)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		sub->cursor_.store(head_.load(std::memory_order_relaxed),
+			std::memory_order_relaxed);
+		subs_.push_back(sub);
+	}
+
+	// a subscription going away may be what held the senders back
+	template <class T>
+	void broadcast_channel<T>::unsubscribe(subscription<T>* sub)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		subs_.erase(std::remove(subs_.begin(), subs_.end(), sub), subs_.end());
+		wake_senders();
+	}
+
+	template <class T>
+	subscription<T>::subscription(broadcast_channel<T>& chan)
+		: chan_(&chan)
+		, cursor_(0)
+		, recvw_(0)
+	{
+		chan_->subscribe(this);
+	}
+
+	template <class T>
+	subscription<T>::~subscription(void)
+	{
+		chan_->unsubscribe(this);
+	}
+
+	// values sent and not yet received, at most a whole ring
+	template <class T>
+	std::size_t subscription<T>::size(void) const
+	{
+		std::uint64_t n = chan_->head_.load(std::memory_order_acquire) -
+			cursor_.load(std::memory_order_acquire);
+		return static_cast<std::size_t>(
+			std::min<std::uint64_t>(n, chan_->capacity_));
+	}
+
+	template <class T>
+	bool subscription<T>::empty(void) const
+	{
+		return size() == 0;
+	}
+
+	template <class T>
+	result<T> subscription<T>::recv(const bool& block)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		return receive(block, lock);
+	}
+
+	template <class T>
+	result<T> subscription<T>::recv_until(
+		const std::chrono::steady_clock::time_point& deadline)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		return receive(true, lock, &deadline);
+	}
+
+	template <class T>
+	result<T> subscription<T>::recv_for(
+		const std::chrono::steady_clock::duration& timeout)
+	{
+		return recv_until(std::chrono::steady_clock::now() + timeout);
+	}
+
+	// nothing can be sent on a subscription
+	template <class T>
+	void subscription<T>::add_sender(waiter*)
+	{
+		throw std::logic_error("send on a subscription");
+	}
+
+	// a waiter must publish itself before it looks at the head one last
+	// time, the mirror image of broadcast_channel::write
+	template <class T>
+	void subscription<T>::add_receiver(waiter* w)
+	{
+		recvq_.push_back(w);
+		recvw_ = recvq_.size();
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (ready())
+			unblock();
+	}
+
+	template <class T>
+	bool subscription<T>::remove_sender(waiter*)
+	{
+		return false;
+	}
+
+	template <class T>
+	bool subscription<T>::remove_receiver(waiter* w)
+	{
+		if (!recvq_.remove(w))
+			return false;
+		recvw_ = recvq_.size();
+		return true;
+	}
+
+	template <class T>
+	void subscription<T>::lock(void)
+	{
+		mutex_.lock();
+	}
+
+	template <class T>
+	void subscription<T>::unlock(void)
+	{
+		mutex_.unlock();
+	}
+
+	// a closed and drained subscription gives T(), as a closed channel
+	// does
+	template <class T>
+	bool subscription<T>::peek(void* data)
+	{
+		int taken = take(data, true);
+		if (taken == -1)
+			new (data) T();
+		return taken != 0;
+	}
+
+	template <class T>
+	bool subscription<T>::poke(void*)
+	{
+		throw std::logic_error("send on a subscription");
+	}
+
+	// called with the lock held; the same wait as basic_channel's, only
+	// a value is always copied out of the ring rather than handed over
+	template <class T>
+	result<T> subscription<T>::receive(const bool& block,
+		std::unique_lock<std::mutex>& lock,
+		const std::chrono::steady_clock::time_point* deadline)
+	{
+		while (true)
+		{
+			slot<T> storage;
+			T* pd = reinterpret_cast<T*>(&storage);
+			int taken = take(&storage, true);
+			if (taken == 1)
+			{
+				result<T> res(std::move(*pd), true);
+				pd->~T();
+				return res;
+			}
+			if (taken == -1)
+				return result<T>(T(), true);
+			if (!block)
+				return result<T>(T(), false);
+			context* ctext = context::get();
+			waiter* w = ctext->add(this, &storage, true);
+			add_receiver(w);
+			lock.unlock();
+			bool woken = true;
+			try
+			{
+				if (deadline == nullptr)
+					ctext->wait();
+				else
+					woken = ctext->wait_until(*deadline);
+			}
+			catch (...)
+			{
+				lock.lock();
+				remove_receiver(w);
+				ctext->clear();
+				return result<T>(T(), false);
+			}
+			if (woken && ctext->get_unblocked_index() != -1)
+			{
+				result<T> res(std::move(*pd), true);
+				pd->~T();
+				ctext->clear();
+				return res;
+			}
+			lock.lock();
+			if (!woken)
+			{
+				remove_receiver(w);
+				ctext->clear();
+				return result<T>(T(), false);
+			}
+			ctext->clear();
+		}
+	}
+
+	// called with the lock held: 1 when a value was copied into data, 0
+	// when there is none yet and -1 once the channel is closed and the
+	// subscription drained. a subscription more than a ring behind skips
+	// to the oldest value still held; under lag_policy::error that throws
+	// when report is set and otherwise is left for the receiver to find.
+	// under lag_policy::block the slot at the cursor is not written over
+	// before the cursor moves past it, so the head is all there is to
+	// look at; closed is read first, a close coming after the last send
+	template <class T>
+	int subscription<T>::take(void* data, const bool& report)
+	{
+		if (chan_->policy_ == lag_policy::block)
+		{
+			bool closed = chan_->closed_;
+			std::uint64_t head = chan_->head_.load(std::memory_order_acquire);
+			std::uint64_t cursor = cursor_.load(std::memory_order_relaxed);
+			if (cursor == head)
+				return closed ? -1 : 0;
+			new (data) T(*reinterpret_cast<T*>(
+				&chan_->buffer_[cursor & chan_->mask_]));
+			cursor_.store(cursor + 1, std::memory_order_release);
+		}
+		else
+		{
+			std::lock_guard<std::mutex> ring_lock(chan_->ring_mutex_);
+			std::uint64_t head = chan_->head_.load(std::memory_order_relaxed);
+			std::uint64_t cursor = cursor_.load(std::memory_order_relaxed);
+			if (cursor == head)
+				return chan_->closed_ ? -1 : 0;
+			if (head - cursor > chan_->capacity_)
+			{
+				if (chan_->policy_ == lag_policy::error && !report)
+					return 0;
+				std::uint64_t oldest = head - chan_->capacity_;
+				cursor_.store(oldest, std::memory_order_release);
+				if (chan_->policy_ == lag_policy::error)
+					throw lag_error(oldest - cursor);
+				cursor = oldest;
+			}
+			new (data) T(*reinterpret_cast<T*>(
+				&chan_->buffer_[cursor & chan_->mask_]));
+			cursor_.store(cursor + 1, std::memory_order_release);
+		}
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (chan_->sendw_.load(std::memory_order_relaxed) != 0)
+			chan_->wake_senders();
+		return 1;
+	}
+
+	template <class T>
+	bool subscription<T>::ready(void) const
+	{
+		return cursor_.load(std::memory_order_relaxed) !=
+			chan_->head_.load(std::memory_order_acquire) || chan_->closed_;
+	}
+
+	// called with the lock held; a parked receiver is given the next
+	// value, or is woken with none to look for itself when the channel
+	// closed or it has a lag to be told of
+	template <class T>
+	void subscription<T>::unblock(void)
+	{
+		while (!recvq_.empty() && ready())
+		{
+			waiter* w = recvq_.pop_front();
+			if (!w->ctext->claim())
+				continue;
+			slot<T> storage;
+			if (take(&storage, false) == 1)
+			{
+				T* pd = reinterpret_cast<T*>(&storage);
+				new (w->ctext->unblocked_receiver(w)) T(std::move(*pd));
+				pd->~T();
+			}
+			w->ctext->signal();
+		}
+		recvw_ = recvq_.size();
+	}
+}
+
+#endif
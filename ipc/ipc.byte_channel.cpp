@@ -0,0 +1,256 @@
+#include "ipc.byte_channel.h"
+#include "ipc.ring.h"
+
+#include <stdexcept>
+#include <thread>
+#include <climits>
+#include <cstring>
+#include <new>
+
+// a frame is its size followed by the payload, padded to 8 bytes; a
+// frame with the pad size fills the rest of the ring up to its end
+namespace
+{
+	const std::uint32_t ready = 0x69706332;
+	const std::uint32_t pad = 0xffffffff;
+	const std::size_t frame_header = 8;
+
+	std::size_t frame_size(const std::size_t& size)
+	{
+		return (frame_header + size + 7) & ~static_cast<std::size_t>(7);
+	}
+}
+
+// head is the receiver's, tail the sender's; state is bumped by every
+// commit, release and close and is the futex word of both sides
+struct ipc::byte_channel::header
+{
+	std::atomic<std::uint32_t> magic;
+	std::uint32_t reserved;
+	std::uint64_t capacity;
+	alignas(cache_line_size) std::atomic<std::uint64_t> head;
+	alignas(cache_line_size) std::atomic<std::uint64_t> tail;
+	alignas(cache_line_size) std::atomic<std::uint32_t> state;
+	std::atomic<std::uint32_t> sleepers;
+	std::atomic<std::uint32_t> closed;
+};
+
+std::size_t ipc::byte_channel::storage_size(const std::size_t& capacity)
+{
+	return sizeof(header) + ceil_pow2(capacity < 64 ? 64 : capacity);
+}
+
+ipc::byte_channel::byte_channel(const std::size_t& capacity)
+	: buffer_(new std::uint64_t[(storage_size(capacity) + cache_line_size) / 8])
+	, header_(nullptr)
+	, data_(nullptr)
+	, capacity_(ceil_pow2(capacity < 64 ? 64 : capacity))
+	, mask_(capacity_ - 1)
+	, reserved_(0)
+	, reserved_size_(0)
+	, reserving_(false)
+	, pending_(0)
+{
+	void* p = buffer_.get();
+	std::size_t space = storage_size(capacity) + cache_line_size;
+	attach(std::align(cache_line_size, storage_size(capacity), p, space), true);
+}
+
+ipc::byte_channel::byte_channel(const std::string& name,
+		const std::size_t& capacity)
+	: segment_(new shm_segment(name, storage_size(capacity)))
+	, header_(nullptr)
+	, data_(nullptr)
+	, capacity_(ceil_pow2(capacity < 64 ? 64 : capacity))
+	, mask_(capacity_ - 1)
+	, reserved_(0)
+	, reserved_size_(0)
+	, reserving_(false)
+	, pending_(0)
+{
+	attach(segment_->address(), segment_->created());
+}
+
+ipc::byte_channel::~byte_channel(void)
+{
+}
+
+// the creator sets the header up and publishes it through magic, the
+// others wait for that before they touch anything else
+void ipc::byte_channel::attach(void* storage, const bool& create)
+{
+	header_ = static_cast<header*>(storage);
+	data_ = reinterpret_cast<unsigned char*>(header_ + 1);
+	if (create)
+	{
+		new (header_) header;
+		header_->capacity = capacity_;
+		header_->head.store(0, std::memory_order_relaxed);
+		header_->tail.store(0, std::memory_order_relaxed);
+		header_->state.store(0, std::memory_order_relaxed);
+		header_->sleepers.store(0, std::memory_order_relaxed);
+		header_->closed.store(0, std::memory_order_relaxed);
+		header_->magic.store(ready, std::memory_order_release);
+	}
+	else
+	{
+		while (header_->magic.load(std::memory_order_acquire) != ready)
+			std::this_thread::yield();
+		if (header_->capacity != capacity_)
+			throw std::runtime_error("byte channel has a different layout");
+	}
+}
+
+std::size_t ipc::byte_channel::capacity(void) const
+{
+	return capacity_;
+}
+
+std::size_t ipc::byte_channel::max_frame(void) const
+{
+	return capacity_ - frame_header;
+}
+
+// returns room for size bytes, or nullptr when block is false and there
+// is none; the room is the sender's until commit. a frame that does not
+// fit before the end of the ring first pads up to it, once the bytes up
+// to the end are free, and then only waits for its own size at offset
+// 0, so any frame up to max_frame fits an empty ring. only the receiver
+// moves head: it skips the pad itself and wakes the sender, so a non
+// blocking reserve that padded may fail until the receiver has been by
+void* ipc::byte_channel::reserve(const std::size_t& size, const bool& block)
+{
+	if (reserving_)
+		throw std::logic_error("commit the previous reservation first");
+	if (size > max_frame())
+		throw std::invalid_argument("frame larger than the channel");
+	std::size_t need = frame_size(size);
+	while (true)
+	{
+		if (header_->closed.load())
+			throw std::runtime_error("send on closed channel");
+		std::uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+		std::uint64_t head = header_->head.load(std::memory_order_acquire);
+		std::size_t end = capacity_ - static_cast<std::size_t>(tail & mask_);
+		std::size_t room = need <= end ? need : end;
+		if (capacity_ - static_cast<std::size_t>(tail - head) >= room)
+		{
+			if (need > end)
+			{
+				std::memcpy(data_ + (tail & mask_), &pad, sizeof(pad));
+				header_->tail.store(tail + end, std::memory_order_release);
+				notify();
+				continue;
+			}
+			reserved_ = tail;
+			reserved_size_ = size;
+			reserving_ = true;
+			return data_ + (tail & mask_) + frame_header;
+		}
+		if (!block)
+			return nullptr;
+		std::uint32_t state = header_->state.load();
+		header_->sleepers.fetch_add(1);
+		head = header_->head.load(std::memory_order_acquire);
+		if (capacity_ - static_cast<std::size_t>(tail - head) < room &&
+				!header_->closed.load())
+			futex_wait(header_->state, state);
+		header_->sleepers.fetch_sub(1);
+	}
+}
+
+// publishes the reserved frame, size being at most what was reserved
+void ipc::byte_channel::commit(const std::size_t& size)
+{
+	if (!reserving_)
+		throw std::logic_error("commit without a reservation");
+	if (size > reserved_size_)
+		throw std::invalid_argument("commit larger than the reservation");
+	std::uint32_t frame = static_cast<std::uint32_t>(size);
+	std::memcpy(data_ + (reserved_ & mask_), &frame, sizeof(frame));
+	header_->tail.store(reserved_ + frame_size(size), std::memory_order_release);
+	reserving_ = false;
+	notify();
+}
+
+bool ipc::byte_channel::send(const void* data, const std::size_t& size,
+	const bool& block)
+{
+	void* p = reserve(size, block);
+	if (p == nullptr)
+		return false;
+	std::memcpy(p, data, size);
+	commit(size);
+	return true;
+}
+
+// the span points into the ring and stays valid until release; once
+// the channel is closed and drained recv reports ok with an empty span,
+// as channel<T> does
+ipc::result<ipc::byte_span> ipc::byte_channel::recv(const bool& block)
+{
+	if (pending_ != 0)
+		throw std::logic_error("release the previous frame first");
+	while (true)
+	{
+		std::uint64_t head = header_->head.load(std::memory_order_relaxed);
+		std::uint64_t tail = header_->tail.load(std::memory_order_acquire);
+		if (head != tail)
+		{
+			std::uint32_t size;
+			std::memcpy(&size, data_ + (head & mask_), sizeof(size));
+			if (size == pad)
+			{
+				head += capacity_ - static_cast<std::size_t>(head & mask_);
+				header_->head.store(head, std::memory_order_release);
+				notify();
+				continue;
+			}
+			pending_ = frame_size(size);
+			byte_span span = { data_ + (head & mask_) + frame_header, size };
+			return result<byte_span>(span, true);
+		}
+		byte_span none = { nullptr, 0 };
+		if (header_->closed.load())
+			return result<byte_span>(none, true);
+		if (!block)
+			return result<byte_span>(none, false);
+		std::uint32_t state = header_->state.load();
+		header_->sleepers.fetch_add(1);
+		if (header_->tail.load(std::memory_order_acquire) == head &&
+				!header_->closed.load())
+			futex_wait(header_->state, state);
+		header_->sleepers.fetch_sub(1);
+	}
+}
+
+void ipc::byte_channel::release(void)
+{
+	if (pending_ == 0)
+		return;
+	std::uint64_t head = header_->head.load(std::memory_order_relaxed);
+	header_->head.store(head + pending_, std::memory_order_release);
+	pending_ = 0;
+	notify();
+}
+
+void ipc::byte_channel::close(void)
+{
+	if (header_->closed.exchange(1) == 0)
+	{
+		header_->state.fetch_add(1);
+		futex_wake(header_->state, INT_MAX);
+	}
+}
+
+void ipc::byte_channel::unlink(const std::string& name)
+{
+	shm_segment::unlink(name);
+}
+
+void ipc::byte_channel::notify(void)
+{
+	header_->state.fetch_add(1);
+	if (header_->sleepers.load() > 0)
+		futex_wake(header_->state, INT_MAX);
+}
@@ -0,0 +1,71 @@
+#ifndef __IPC_BYTE_CHANNEL__
+#define __IPC_BYTE_CHANNEL__
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+#include "ipc.channel.h"
+#include "ipc.shm.h"
+#include "ipc.noncopyable.h"
+
+namespace ipc
+{
+	// a frame handed out by byte_channel::recv, valid until release
+	struct byte_span
+	{
+		const void* data;
+		std::size_t size;
+	};
+
+	// a channel of variable length byte frames for one sender and one
+	// receiver at a time, in this process or, given a name, between
+	// processes over a shared memory segment. the sender reserves room,
+	// writes the frame in place and commits it; the receiver gets a span
+	// straight into the ring and releases it when done, so a frame is
+	// never copied. frames never wrap, a frame that does not fit before
+	// the end of the ring starts over at its beginning
+	class byte_channel : public noncopyable
+	{
+		struct header;
+
+		std::unique_ptr<shm_segment> segment_;
+		std::unique_ptr<std::uint64_t[]> buffer_;
+		header* header_;
+		unsigned char* data_;
+		std::size_t capacity_;
+		std::size_t mask_;
+
+		std::uint64_t reserved_;
+		std::size_t reserved_size_;
+		bool reserving_;
+		std::size_t pending_;
+	public:
+		byte_channel(const std::size_t& capacity);
+		byte_channel(const std::string& name, const std::size_t& capacity);
+		virtual ~byte_channel(void);
+	public:
+		std::size_t capacity(void) const;
+		std::size_t max_frame(void) const;
+	public:
+		void* reserve(const std::size_t& size, const bool& block = true);
+		void commit(const std::size_t& size);
+		bool send(const void* data, const std::size_t& size,
+			const bool& block = true);
+	public:
+		result<byte_span> recv(const bool& block = true);
+		void release(void);
+	public:
+		void close(void);
+	public:
+		static void unlink(const std::string& name);
+	private:
+		static std::size_t storage_size(const std::size_t& capacity);
+		void attach(void* storage, const bool& create);
+		void notify(void);
+	};
+}
+
+#endif
@@ -6,9 +6,15 @@
 #include <vector>
 #include <array>
 #include <mutex>
+#include <algorithm>
+#include <utility>
 #include <stdexcept>
+#include <functional>
+#include <chrono>
 
+#include "ipc.ring.h"
 #include "ipc.context.h"
+#include "ipc.readiness.h"
 #include "ipc.noncopyable.h" 
 
 namespace ipc
@@ -18,6 +24,7 @@ namespace ipc
 		T data;
 		bool ok;
 		result(const T& d, const bool& k);
+		result(T&& d, const bool& k);
 	};
 
 	template <class T>
@@ -27,307 +34,906 @@ namespace ipc
 	{
 	}
 
+	template <class T>
+	result<T>::result(T&& d, const bool& k)
+		: data(std::move(d))
+		, ok(k)
+	{
+	}
+
+#if defined(__cpp_impl_coroutine)
+	template <class Chan>
+	class recv_awaitable;
+	template <class Chan>
+	class send_awaitable;
+#endif
+
 	struct channable
 	{
-		virtual void* peek(void) = 0;
+		virtual void lock(void) = 0;
+		virtual void unlock(void) = 0;
+		virtual bool peek(void* data) = 0;
 		virtual bool poke(void* data) = 0;
-		virtual void add_sender(const std::shared_ptr<context>& ctext) = 0;
-		virtual void add_receiver(const std::shared_ptr<context>& ctext) = 0;
-		virtual bool remove_sender(const std::shared_ptr<context>& ctext) = 0;
-		virtual bool remove_receiver(const std::shared_ptr<context>& ctext) = 0;
+		virtual void add_sender(waiter* w) = 0;
+		virtual void add_receiver(waiter* w) = 0;
+		virtual bool remove_sender(waiter* w) = 0;
+		virtual bool remove_receiver(waiter* w) = 0;
+		virtual void settle(void) {}	// with no lock held, see basic_channel
 		virtual ~channable(void) {}
 	};
 
-	template <class T>
-	class channel : public channable, public noncopyable
+	// a channel over a lock free ring: send and recv only touch the ring
+	// while neither side has to park, and take the lock when the ring is
+	// full or empty or when the other side has parked waiters; a ring of
+	// size 0 makes it unbuffered, every value handed from a parked sender
+	// or to a parked receiver under the lock
+	template <class T, class Ring>
+	class basic_channel : public channable, public noncopyable
 	{
-		std::shared_ptr<T[]> buffer_;
-		int size_;
-
-		std::vector<std::shared_ptr<context>> recvq_;
-		std::vector<std::shared_ptr<context>> sendq_;
+		Ring ring_;
 
+		// read by every lock free send and recv, written only when a side
+		// parks or the channel is closed
+		alignas(cache_line_size) std::atomic_size_t recvw_;
+		std::atomic_size_t sendw_;
 		std::atomic_bool closed_;
-		std::atomic_int count_;
 
-		std::size_t sendx_;
-		std::size_t recvx_;
+		readiness recv_ready_;
+		readiness send_ready_;
+
+		// written on every slow path, kept off the line above
+		alignas(cache_line_size) std::mutex mutex_;
+
+		waitq recvq_;
+		waitq sendq_;
 	public:
-		channel(int size = 0);
+		typedef T value_type;
+	public:
+		basic_channel(int size = 0);
 	public:
 		std::size_t capacity(void) const;
 		std::size_t size(void) const;
 		bool empty(void) const;
 	public:
 		bool send(const T& data, const bool& block = true);
+		bool send(T&& data, const bool& block = true);
+		template <class... Args>
+		bool emplace(Args&&... args);
+	public:
+		bool send_until(const T& data,
+			const std::chrono::steady_clock::time_point& deadline);
+		bool send_until(T&& data,
+			const std::chrono::steady_clock::time_point& deadline);
+		bool send_for(const T& data,
+			const std::chrono::steady_clock::duration& timeout);
+		bool send_for(T&& data,
+			const std::chrono::steady_clock::duration& timeout);
 	public:
 		result<T> recv(const bool& block = true);
+		result<T> recv_until(
+			const std::chrono::steady_clock::time_point& deadline);
+		result<T> recv_for(const std::chrono::steady_clock::duration& timeout);
+	public:
+		template <class InputIt>
+		std::size_t send_n(InputIt first, InputIt last);
+		template <class OutputIt>
+		std::size_t recv_n(OutputIt out, const std::size_t& max,
+			const std::size_t& min_wait = 1);
 	public:
+#if defined(__cpp_impl_coroutine)
+		// defined in ipc.async.h, which must be included to use them
+		recv_awaitable<basic_channel> async_recv(void);
+		send_awaitable<basic_channel> async_send(const T& data);
+		send_awaitable<basic_channel> async_send(T&& data);
+	public:
+#endif
 		void close(void);
 	public:
-		void add_sender(const std::shared_ptr<context>& ctext);
-		void add_receiver(const std::shared_ptr<context>& ctext);
+		int recv_fd(void);
+		int send_fd(void);
+	public:
+		void add_sender(waiter* w);
+		void add_receiver(waiter* w);
+	public:
+		bool remove_sender(waiter* w);
+		bool remove_receiver(waiter* w);
 	public:
-		bool remove_sender(const std::shared_ptr<context>& ctext);
-		bool remove_receiver(const std::shared_ptr<context>& ctext);
+		void lock(void);
+		void unlock(void);
 	public:
-		void* peek(void);
+		bool peek(void* data);
 		bool poke(void* data);
+	public:
+		void settle(void);
+	protected:
+		Ring& ring(void);
+	private:
+		bool dispatch(T& data, const bool& block,
+			std::unique_lock<std::mutex>& lock,
+			const std::chrono::steady_clock::time_point* deadline = nullptr);
+		result<T> receive(const bool& block,
+			std::unique_lock<std::mutex>& lock,
+			const std::chrono::steady_clock::time_point* deadline = nullptr);
+		template <class R>
+		R leave(std::unique_lock<std::mutex>& lock, R r);
 	private:
-		bool dispatch(const T& data, const bool& block);
-		result<T> receive(const bool& block);
+		void notify(const std::atomic_size_t& waiters, readiness& ready);
+		void unblock(void);
+		void rearm_recv(void);
+		void rearm_send(void);
 	};
 
-	template <class T>
-	channel<T>::channel(int size)
-		: closed_(false)
-		, count_(0)
-		, sendx_(0)
-		, recvx_(0)
-		, size_(size)
-		, buffer_(new T[size], std::default_delete<T[]>())
+	template <class T, class Ring>
+	basic_channel<T, Ring>::basic_channel(int size)
+		: ring_(size < 0 ? 0 : size)
+		, recvw_(0)
+		, sendw_(0)
+		, closed_(false)
 	{
 	}
 
-	template <class T>
-	std::size_t channel<T>::capacity(void) const
+	template <class T, class Ring>
+	std::size_t basic_channel<T, Ring>::capacity(void) const
 	{
-		return size_;
+		return ring_.capacity();
 	}
 
-	template <class T>
-	std::size_t channel<T>::size(void) const
+	template <class T, class Ring>
+	std::size_t basic_channel<T, Ring>::size(void) const
 	{
-		return count_;
+		return ring_.size();
 	}
 
-	template <class T>
-	bool channel<T>::empty(void) const
+	template <class T, class Ring>
+	bool basic_channel<T, Ring>::empty(void) const
 	{
 		return size() == 0;
 	}
 
-	template <class T>
-	bool channel<T>::send(const T& data, const bool& block)
+	template <class T, class Ring>
+	bool basic_channel<T, Ring>::send(const T& data, const bool& block)
 	{
-		if (!block && ((capacity() == 0 && recvq_.empty()) ||
-			(capacity() > 0 && size() == capacity())) && !closed_)
+		if (closed_)
+			throw std::runtime_error("send on closed channel");
+		if (ring_.try_push(data))
+		{
+			notify(recvw_, recv_ready_);
+			return true;
+		}
+		if (!block && recvw_ == 0)
+		{
+			rearm_send();
 			return false;
-		std::lock_guard<std::mutex> lock(context::mutex);
-		return dispatch(data, block);
+		}
+		T copy(data);
+		std::unique_lock<std::mutex> lock(mutex_);
+		return leave(lock, dispatch(copy, block, lock));
 	}
 
-	template <class T>
-	result<T> channel<T>::recv(const bool& block)
+	// the value is only moved from once it has been delivered, a failed
+	// non blocking send leaves it with the caller
+	template <class T, class Ring>
+	bool basic_channel<T, Ring>::send(T&& data, const bool& block)
 	{
-		if (!block && ((capacity() == 0 && sendq_.empty()) ||
-			(capacity() > 0 && size() == 0)) && !closed_)
+		if (closed_)
+			throw std::runtime_error("send on closed channel");
+		if (ring_.try_push(std::move(data)))
+		{
+			notify(recvw_, recv_ready_);
+			return true;
+		}
+		if (!block && recvw_ == 0)
+		{
+			rearm_send();
+			return false;
+		}
+		std::unique_lock<std::mutex> lock(mutex_);
+		return leave(lock, dispatch(data, block, lock));
+	}
+
+	template <class T, class Ring>
+	template <class... Args>
+	bool basic_channel<T, Ring>::emplace(Args&&... args)
+	{
+		if (closed_)
+			throw std::runtime_error("send on closed channel");
+		if (ring_.try_emplace(std::forward<Args>(args)...))
+		{
+			notify(recvw_, recv_ready_);
+			return true;
+		}
+		T data(std::forward<Args>(args)...);
+		std::unique_lock<std::mutex> lock(mutex_);
+		return leave(lock, dispatch(data, true, lock));
+	}
+
+	// the timed variants give up once the deadline has passed, returning
+	// false and leaving a value that was moved in with the caller
+	template <class T, class Ring>
+	bool basic_channel<T, Ring>::send_until(const T& data,
+		const std::chrono::steady_clock::time_point& deadline)
+	{
+		if (closed_)
+			throw std::runtime_error("send on closed channel");
+		if (ring_.try_push(data))
+		{
+			notify(recvw_, recv_ready_);
+			return true;
+		}
+		T copy(data);
+		std::unique_lock<std::mutex> lock(mutex_);
+		return leave(lock, dispatch(copy, true, lock, &deadline));
+	}
+
+	template <class T, class Ring>
+	bool basic_channel<T, Ring>::send_until(T&& data,
+		const std::chrono::steady_clock::time_point& deadline)
+	{
+		if (closed_)
+			throw std::runtime_error("send on closed channel");
+		if (ring_.try_push(std::move(data)))
+		{
+			notify(recvw_, recv_ready_);
+			return true;
+		}
+		std::unique_lock<std::mutex> lock(mutex_);
+		return leave(lock, dispatch(data, true, lock, &deadline));
+	}
+
+	template <class T, class Ring>
+	bool basic_channel<T, Ring>::send_for(const T& data,
+		const std::chrono::steady_clock::duration& timeout)
+	{
+		return send_until(data, std::chrono::steady_clock::now() + timeout);
+	}
+
+	template <class T, class Ring>
+	bool basic_channel<T, Ring>::send_for(T&& data,
+		const std::chrono::steady_clock::duration& timeout)
+	{
+		return send_until(std::move(data),
+			std::chrono::steady_clock::now() + timeout);
+	}
+
+	// an unbuffered channel has no ring to look at, so the value is not
+	// default constructed only to find it empty
+	template <class T, class Ring>
+	result<T> basic_channel<T, Ring>::recv(const bool& block)
+	{
+		if (ring_.capacity() != 0)
+		{
+			T data;
+			if (ring_.try_pop(data))
+			{
+				notify(sendw_, send_ready_);
+				return result<T>(std::move(data), true);
+			}
+		}
+		if (!block && sendw_ == 0 && !closed_)
+		{
+			rearm_recv();
 			return result<T>(T(), false);
-		std::lock_guard<std::mutex> lock(context::mutex);
-		return receive(block);
+		}
+		std::unique_lock<std::mutex> lock(mutex_);
+		return leave(lock, receive(block, lock));
 	}
 
-	template <class T>
-	void channel<T>::close(void)
+	template <class T, class Ring>
+	result<T> basic_channel<T, Ring>::recv_until(
+		const std::chrono::steady_clock::time_point& deadline)
+	{
+		if (ring_.capacity() != 0)
+		{
+			T data;
+			if (ring_.try_pop(data))
+			{
+				notify(sendw_, send_ready_);
+				return result<T>(std::move(data), true);
+			}
+		}
+		std::unique_lock<std::mutex> lock(mutex_);
+		return leave(lock, receive(true, lock, &deadline));
+	}
+
+	template <class T, class Ring>
+	result<T> basic_channel<T, Ring>::recv_for(
+		const std::chrono::steady_clock::duration& timeout)
+	{
+		return recv_until(std::chrono::steady_clock::now() + timeout);
+	}
+
+	// sends as many values as fit under one hold of the lock, handing them
+	// straight to parked receivers while the ring is empty; parks with the
+	// first value only when nothing fits, and returns how many were sent.
+	// values are copied or moved as the iterator dereferences
+	template <class T, class Ring>
+	template <class InputIt>
+	std::size_t basic_channel<T, Ring>::send_n(InputIt first, InputIt last)
+	{
+		if (first == last)
+			return 0;
+		std::unique_lock<std::mutex> lock(mutex_);
+		if (closed_)
+			throw std::runtime_error("send on closed channel");
+		std::size_t n = 0;
+		while (first != last)
+		{
+			if (ring_.empty() && !recvq_.empty())
+			{
+				waiter* w = recvq_.pop_front();
+				recvw_ = recvq_.size();
+				if (!w->ctext->claim())
+					continue;
+				new (w->ctext->unblocked_receiver(w)) T(*first);
+				w->ctext->signal();
+			}
+			else if (!ring_.try_push(*first))
+			{
+				if (n > 0)
+					break;
+				T data(*first);
+				dispatch(data, true, lock);
+				if (!lock.owns_lock())
+					lock.lock();
+			}
+			++first;
+			++n;
+		}
+		unblock();
+		if (first != last)
+			rearm_send();
+		return leave(lock, n);
+	}
+
+	// takes up to max values under one hold of the lock, parking until at
+	// least min_wait have arrived or the channel is closed; returns how
+	// many were written to out
+	template <class T, class Ring>
+	template <class OutputIt>
+	std::size_t basic_channel<T, Ring>::recv_n(OutputIt out,
+		const std::size_t& max, const std::size_t& min_wait)
 	{
-		std::lock_guard<std::mutex> lock(context::mutex);
+		std::unique_lock<std::mutex> lock(mutex_);
+		std::size_t n = 0;
+		while (n < max)
+		{
+			T data;
+			if (ring_.try_pop(data))
+			{
+				*out++ = std::move(data);
+				n++;
+				continue;
+			}
+			if (!sendq_.empty())
+			{
+				waiter* w = sendq_.pop_front();
+				sendw_ = sendq_.size();
+				if (!w->ctext->claim())
+					continue;
+				*out++ = std::move(*static_cast<T*>(w->ctext->unblocked_sender(w)));
+				w->ctext->signal();
+				n++;
+				continue;
+			}
+			if (n >= min_wait || closed_)
+				break;
+			slot<T> storage;
+			context* ctext = context::get();
+			waiter* w = ctext->add(this, &storage, true);
+			add_receiver(w);
+			lock.unlock();
+			try
+			{
+				ctext->wait();
+			}
+			catch (...)
+			{
+				lock.lock();
+				remove_receiver(w);
+				ctext->clear();
+				break;
+			}
+			lock.lock();
+			if (ctext->get_unblocked_index() != -1)
+			{
+				T* pd = reinterpret_cast<T*>(&storage);
+				*out++ = std::move(*pd);
+				pd->~T();
+				n++;
+			}
+			ctext->clear();
+		}
+		unblock();
+		if (n < max)
+			rearm_recv();
+		return leave(lock, n);
+	}
+
+	template <class T, class Ring>
+	void basic_channel<T, Ring>::close(void)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
 		if (!closed_)
 		{
 			closed_ = true;
-			for (auto q: recvq_)
-				q->signal();
-			for (auto q: sendq_)
-				q->signal();
+			while (waiter* w = recvq_.pop_front())
+				if (w->ctext->claim())
+					w->ctext->signal();
+			while (waiter* w = sendq_.pop_front())
+				if (w->ctext->claim())
+					w->ctext->signal();
+			recvw_ = 0;
+			sendw_ = 0;
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			recv_ready_.raise();
+			send_ready_.raise();
 		}
 	}
 
-	template <class T>
-	void channel<T>::add_sender(const std::shared_ptr<context>& ctext)
+	// readiness fds for epoll and friends, opened on first use: recv_fd
+	// becomes readable when a value can be received or the channel was
+	// closed, send_fd when a value can be sent. both are edge triggered,
+	// after a wake read the fd and drain with recv(false) or send(v, false)
+	// until it fails, which is what rearms the fd
+	template <class T, class Ring>
+	int basic_channel<T, Ring>::recv_fd(void)
 	{
-		sendq_.push_back(ctext);
+		return recv_ready_.fd();
 	}
 
-	template <class T>
-	void channel<T>::add_receiver(const std::shared_ptr<context>& ctext)
+	template <class T, class Ring>
+	int basic_channel<T, Ring>::send_fd(void)
 	{
-		recvq_.push_back(ctext);
+		return send_ready_.fd();
 	}
 
-	template <class T>
-	bool channel<T>::remove_sender(const std::shared_ptr<context>& ctext)
+	// a waiter must publish itself before it looks at the ring one last
+	// time, the mirror image of notify
+	template <class T, class Ring>
+	void basic_channel<T, Ring>::add_sender(waiter* w)
 	{
-		auto it = std::find(sendq_.begin(), sendq_.end(), ctext);
-		if (it != sendq_.end())
-			sendq_.erase(it);
-		else
+		sendq_.push_back(w);
+		sendw_ = sendq_.size();
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		recv_ready_.raise();
+		if (!ring_.full())
+			unblock();
+	}
+
+	template <class T, class Ring>
+	void basic_channel<T, Ring>::add_receiver(waiter* w)
+	{
+		recvq_.push_back(w);
+		recvw_ = recvq_.size();
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		send_ready_.raise();
+		if (!ring_.empty())
+			unblock();
+	}
+
+	template <class T, class Ring>
+	bool basic_channel<T, Ring>::remove_sender(waiter* w)
+	{
+		if (!sendq_.remove(w))
 			return false;
+		sendw_ = sendq_.size();
 		return true;
 	}
 
-	template <class T>
-	bool channel<T>::remove_receiver(const std::shared_ptr<context>& ctext)
+	template <class T, class Ring>
+	bool basic_channel<T, Ring>::remove_receiver(waiter* w)
 	{
-		auto it = std::find(recvq_.begin(), recvq_.end(), ctext);
-		if (it != recvq_.end())
-			recvq_.erase(it);
-		else
+		if (!recvq_.remove(w))
 			return false;
+		recvw_ = recvq_.size();
 		return true;
 	}
 
-	template <class T>
-	void* channel<T>::peek(void)
+	template <class T, class Ring>
+	void basic_channel<T, Ring>::lock(void)
 	{
-		result<T> res = recv(false);
-		return res.ok ? new T(res.data) : nullptr;
+		mutex_.lock();
 	}
 
-	template <class T>
-	bool channel<T>::poke(void* data)
+	template <class T, class Ring>
+	void basic_channel<T, Ring>::unlock(void)
 	{
-		return send(*static_cast<T*>(data), false);
+		mutex_.unlock();
 	}
 
-	template <class T>
-	bool channel<T>::dispatch(const T& data, const bool& block)
+	// peek constructs the value in the raw storage the selector provides;
+	// both run under the lock select holds, which a call that does not
+	// block never lets go of. the lock stays select's to release, also
+	// when the call throws, as select unlocks its channels on the way out
+	template <class T, class Ring>
+	bool basic_channel<T, Ring>::peek(void* data)
+	{
+		std::unique_lock<std::mutex> lock(mutex_, std::adopt_lock);
+		try
+		{
+			result<T> res = receive(false, lock);
+			lock.release();
+			if (res.ok)
+				new (data) T(std::move(res.data));
+			return res.ok;
+		}
+		catch (...)
+		{
+			lock.release();
+			throw;
+		}
+	}
+
+	template <class T, class Ring>
+	bool basic_channel<T, Ring>::poke(void* data)
+	{
+		std::unique_lock<std::mutex> lock(mutex_, std::adopt_lock);
+		try
+		{
+			bool ok = dispatch(*static_cast<T*>(data), false, lock);
+			lock.release();
+			return ok;
+		}
+		catch (...)
+		{
+			lock.release();
+			throw;
+		}
+	}
+
+	// a ring may record something under the lock that must only be
+	// acted on once no lock is held, an unbounded channel's high water
+	// mark; every call settles on its way out, and select settles every
+	// channel once it has unlocked them all
+	template <class T, class Ring>
+	void basic_channel<T, Ring>::settle(void)
+	{
+		ring_.settle();
+	}
+
+	template <class T, class Ring>
+	Ring& basic_channel<T, Ring>::ring(void)
+	{
+		return ring_;
+	}
+
+	// called with the lock held; a parked waiter of the other side gets
+	// the value handed over directly, one lock and one wake. once woken
+	// with its value taken, or given one, a waiter returns without taking
+	// the lock again, the waker having already unlinked its node, and
+	// leaves lock released; only a retry, a timeout or an exception takes
+	// it again
+	template <class T, class Ring>
+	bool basic_channel<T, Ring>::dispatch(T& data, const bool& block,
+		std::unique_lock<std::mutex>& lock,
+		const std::chrono::steady_clock::time_point* deadline)
 	{
 		while (true)
 		{
 			if (closed_)
 				throw std::runtime_error("send on closed channel");
-			if (!recvq_.empty() && size() > 0)
+			while (!recvq_.empty() && ring_.empty())
 			{
-				std::shared_ptr<context> ctext = recvq_.front();
-				sendq_.erase(recvq_.begin());
-				ctext->unblocked_receiver(this, new T(buffer_.get()[recvx_]));
-				if (++recvx_ >= capacity())
-					recvx_ = 0;
-				count_++;
-				ctext->signal();
-			}
-			if (!recvq_.empty())
-			{
-				std::shared_ptr<context> ctext = recvq_.front();
-				recvq_.erase(recvq_.begin());
-				ctext->unblocked_receiver(this, new T(data));
-				ctext->signal();
+				waiter* w = recvq_.pop_front();
+				recvw_ = recvq_.size();
+				if (!w->ctext->claim())
+					continue;
+				new (w->ctext->unblocked_receiver(w)) T(std::move(data));
+				w->ctext->signal();
 				return true;
 			}
-			if (size() < capacity())
+			if (ring_.capacity() != 0 && ring_.try_push(std::move(data)))
 			{
-				buffer_.get()[sendx_] = data;
-				sendx_++;
-				if (sendx_ == capacity())
-					sendx_ = 0;
-				count_++;
+				unblock();
 				return true;
 			}
 			if (!block)
+			{
+				rearm_send();
 				return false;
-			std::shared_ptr<context> ctext = context::get();
-			ctext->add(this, new T(data));
-			sendq_.push_back(ctext);
+			}
+			context* ctext = context::get();
+			waiter* w = ctext->add(this, &data);
+			add_sender(w);
+			lock.unlock();
+			bool woken = true;
 			try
 			{
-				ctext->wait();
+				if (deadline == nullptr)
+					ctext->wait();
+				else
+					woken = ctext->wait_until(*deadline);
 			}
 			catch (...)
 			{
-				auto it = std::find(sendq_.begin(), sendq_.end(), ctext);
-				if (it != sendq_.end())
-					sendq_.erase(it);
+				lock.lock();
+				remove_sender(w);
 				ctext->clear();
 				return true;
 			}
-			auto it = std::find(sendq_.begin(), sendq_.end(), ctext);
-			if (it != sendq_.end())
+			if (woken && ctext->get_unblocked_index() != -1)
 			{
 				ctext->clear();
-				throw std::runtime_error("not removed from send queue");
+				return true;
 			}
-			if (ctext->get_unblocked_index() != -1)
+			lock.lock();
+			if (!woken)
 			{
+				remove_sender(w);
 				ctext->clear();
-				return true;
+				return false;
 			}
 			ctext->clear();
 		}
 	}
 
-	template <class T>
-	result<T> channel<T>::receive(const bool& block)
+	template <class T, class Ring>
+	result<T> basic_channel<T, Ring>::receive(const bool& block,
+		std::unique_lock<std::mutex>& lock,
+		const std::chrono::steady_clock::time_point* deadline)
 	{
 		while (true)
 		{
-			if (closed_ && size() == 0)
-				return result<T>(T(), true);	// todo
-			T data;
-			bool has_data(false);
-			if (size() > 0)
+			if (ring_.capacity() != 0)
 			{
-				data = buffer_.get()[recvx_];
-				recvx_++;
-				if (recvx_ == capacity())
-					recvx_ = 0;
-				count_--;
-				has_data = true;
+				T data;
+				if (ring_.try_pop(data))
+				{
+					unblock();
+					return result<T>(std::move(data), true);
+				}
 			}
-			if (!has_data && !sendq_.empty())
+			while (!sendq_.empty())
 			{
-				std::shared_ptr<context> ctext = sendq_.front();
-				sendq_.erase(sendq_.begin());
-				void* pd = ctext->unblocked_sender(this);
-				data = *static_cast<T*>(pd);
-				delete pd;
-				has_data = true;
-				ctext->signal();
+				waiter* w = sendq_.pop_front();
+				sendw_ = sendq_.size();
+				if (!w->ctext->claim())
+					continue;
+				result<T> res(std::move(*static_cast<T*>(
+					w->ctext->unblocked_sender(w))), true);
+				w->ctext->signal();
+				return res;
 			}
-			if (!sendq_.empty() && size() < capacity())
+			if (closed_)
+				return result<T>(T(), true);	// todo
+			if (!block)
 			{
-				std::shared_ptr<context> ctext = sendq_.front();
-				sendq_.erase(sendq_.begin());
-				void* pd = ctext->unblocked_sender(this);
-				buffer_.get()[sendx_] = *static_cast<T*>(pd);
-				delete pd;
-				if (++sendx_ >= capacity())
-					sendx_ = 0;
-				count_++;
-				ctext->signal();
+				rearm_recv();
+				return result<T>(T(), false);
 			}
-			if (has_data)
-				return result<T>(data, true);
-			std::shared_ptr<context> ctext = context::get();
-			ctext->add(this);
-			recvq_.push_back(ctext);
+			slot<T> storage;
+			context* ctext = context::get();
+			waiter* w = ctext->add(this, &storage, true);
+			add_receiver(w);
+			lock.unlock();
+			bool woken = true;
 			try
 			{
-				ctext->wait();
+				if (deadline == nullptr)
+					ctext->wait();
+				else
+					woken = ctext->wait_until(*deadline);
 			}
 			catch (...)
 			{
-				auto it = std::find(recvq_.begin(), recvq_.end(), ctext);
-				if (it != recvq_.end())
-					recvq_.erase(it);
+				lock.lock();
+				remove_receiver(w);
 				ctext->clear();
 				return result<T>(T(), false);
 			}
-			auto it = std::find(recvq_.begin(), recvq_.end(), ctext);
-			if (it != recvq_.end())
+			if (woken && ctext->get_unblocked_index() != -1)
 			{
+				T* pd = reinterpret_cast<T*>(&storage);
+				result<T> res(std::move(*pd), true);
+				pd->~T();
 				ctext->clear();
-				throw std::runtime_error("not removed from receive queue");
+				return res;
 			}
-			if (ctext->get_unblocked_index() != -1)
+			lock.lock();
+			if (!woken)
 			{
-				void* pd = ctext->get_receive_data();
-				data = *static_cast<T*>(pd);
-				delete pd;
+				remove_receiver(w);
 				ctext->clear();
-				return result<T>(data, true);
+				return result<T>(T(), false);
 			}
 			ctext->clear();
 		}
 	}
+
+	// returns r with the lock released, which dispatch and receive may
+	// already have done, and the ring settled
+	template <class T, class Ring>
+	template <class R>
+	R basic_channel<T, Ring>::leave(std::unique_lock<std::mutex>& lock, R r)
+	{
+		if (lock.owns_lock())
+			lock.unlock();
+		ring_.settle();
+		return r;
+	}
+
+	// called after a lock free push or pop; the fence pairs with the one
+	// in add_sender/add_receiver so that either the waiter sees the ring
+	// change or we see the waiter, and likewise with the one in rearm_*
+	template <class T, class Ring>
+	void basic_channel<T, Ring>::notify(const std::atomic_size_t& waiters,
+		readiness& ready)
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		ready.raise();
+		if (waiters.load(std::memory_order_relaxed) != 0)
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			unblock();
+		}
+		ring_.settle();
+	}
+
+	// with the lock held, hand buffered values to parked receivers and
+	// move the values of parked senders into free slots; a waiter that
+	// was claimed but lost its value to a lock free peer is woken with
+	// no result and retries
+	template <class T, class Ring>
+	void basic_channel<T, Ring>::unblock(void)
+	{
+		bool progress = true;
+		while (progress)
+		{
+			progress = false;
+			if (!recvq_.empty() && !ring_.empty())
+			{
+				waiter* w = recvq_.pop_front();
+				if (w->ctext->claim())
+				{
+					T data;
+					if (ring_.try_pop(data))
+						new (w->ctext->unblocked_receiver(w)) T(std::move(data));
+					w->ctext->signal();
+				}
+				progress = true;
+			}
+			if (!sendq_.empty() && !ring_.full())
+			{
+				waiter* w = sendq_.pop_front();
+				if (w->ctext->claim())
+				{
+					if (ring_.try_push(std::move(*static_cast<T*>(w->data))))
+						w->ctext->unblocked_sender(w);
+					w->ctext->signal();
+				}
+				progress = true;
+			}
+		}
+		recvw_ = recvq_.size();
+		sendw_ = sendq_.size();
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (!ring_.empty() || !sendq_.empty())
+			recv_ready_.raise();
+		if (!ring_.full() || !recvq_.empty())
+			send_ready_.raise();
+	}
+
+	// a non blocking call found nothing to do: arm the fd, then look once
+	// more, so a change that raced with us raises it rather than being lost
+	template <class T, class Ring>
+	void basic_channel<T, Ring>::rearm_recv(void)
+	{
+		if (!recv_ready_.opened())
+			return;
+		recv_ready_.arm();
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (!ring_.empty() || sendw_ != 0 || closed_)
+			recv_ready_.raise();
+	}
+
+	template <class T, class Ring>
+	void basic_channel<T, Ring>::rearm_send(void)
+	{
+		if (!send_ready_.opened())
+			return;
+		send_ready_.arm();
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (!ring_.full() || recvw_ != 0 || closed_)
+			send_ready_.raise();
+	}
+
+	// single producer, single consumer channel; at most one thread may
+	// send and at most one thread may receive at any time
+	template <class T>
+	class spsc_channel : public basic_channel<T, spsc_ring<T>>
+	{
+	public:
+		spsc_channel(int size = 1);
+	};
+
+	template <class T>
+	spsc_channel<T>::spsc_channel(int size)
+		: basic_channel<T, spsc_ring<T>>(size)
+	{
+	}
+
+	// a channel without a bound: send never blocks, the backlog growing a
+	// segment at a time and shrinking back as it drains. capacity reports
+	// the largest size_t. on_high_water, when given, is called each time
+	// the backlog reaches high_water, on a thread using the channel once
+	// it holds no channel lock, so it may use this channel or any other
+	template <class T>
+	class unbounded_channel : public basic_channel<T, segmented_ring<T>>
+	{
+	public:
+		unbounded_channel(const std::size_t& high_water = 0,
+			const std::function<void(std::size_t)>& on_high_water = nullptr);
+	};
+
+	template <class T>
+	unbounded_channel<T>::unbounded_channel(const std::size_t& high_water,
+		const std::function<void(std::size_t)>& on_high_water)
+		: basic_channel<T, segmented_ring<T>>(0)
+	{
+		this->ring().set_high_water(high_water, on_high_water);
+	}
+
+	// a channel whose values are received highest level first, level 0
+	// the highest and level_of telling the level of each value sent; it
+	// holds size values across all levels. the order applies to what is
+	// buffered, senders parked on a full channel going in as they came.
+	// level_of may be called under the ring's lock and must not touch
+	// the channel. a size of 0 makes it unbuffered and the levels moot
+	template <class T>
+	class priority_channel : public basic_channel<T, priority_ring<T>>
+	{
+	public:
+		priority_channel(int size, const std::size_t& levels,
+			const std::function<std::size_t(const T&)>& level_of);
+	};
+
+	template <class T>
+	priority_channel<T>::priority_channel(int size, const std::size_t& levels,
+		const std::function<std::size_t(const T&)>& level_of)
+		: basic_channel<T, priority_ring<T>>(size)
+	{
+		this->ring().set_levels(levels, level_of);
+	}
+
+	// a channel of N values held inline, N rounded up to a power of two;
+	// channel<T> with no N is the general one below. the capacity is known
+	// at compile time, so it can size other things there
+	template <class T, std::size_t N = 0>
+	class channel : public basic_channel<T, fixed_ring<T, N>>
+	{
+	public:
+		channel(void);
+	public:
+		static constexpr std::size_t capacity(void);
+	};
+
+	template <class T, std::size_t N>
+	channel<T, N>::channel(void)
+		: basic_channel<T, fixed_ring<T, N>>(static_cast<int>(N))
+	{
+	}
+
+	template <class T, std::size_t N>
+	constexpr std::size_t channel<T, N>::capacity(void)
+	{
+		return ceil_pow2(N);
+	}
+
+	// the general channel; unbuffered when size is 0, otherwise buffered
+	// over a lock free ring shared by any number of senders and receivers,
+	// its size rounded up to a power of two
+	template <class T>
+	class channel<T, 0> : public basic_channel<T, mpmc_ring<T>>
+	{
+	public:
+		channel(int size = 0);
+	};
+
+	template <class T>
+	channel<T, 0>::channel(int size)
+		: basic_channel<T, mpmc_ring<T>>(size)
+	{
+	}
 }
 
 #endif
@@ -1,75 +1,128 @@
+
 #include "ipc.channel.h"
 #include "ipc.context.h"
 
 #include <stdexcept>
-#include <cstdlib>
-#include <ctime>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#define IPC_PAUSE() _mm_pause()
+#else
+#define IPC_PAUSE() ((void)0)
+#endif
+
+thread_local ipc::context ipc::context::context_;
+thread_local ipc::context* ipc::context::current_ = nullptr;
 
-ipc::threadvar<ipc::context> ipc::context::context_;
-std::mutex ipc::context::mutex;
+// spinning only pays when the peer runs on another core
+std::atomic_size_t ipc::context::max_spin_(
+	std::thread::hardware_concurrency() > 1 ? 4096 : 0);
+std::atomic_size_t ipc::context::max_yield_(8);
 
 ipc::context::context(void)
-	: recv_data_(nullptr)
-	, count_(0)
+	: spin_(64)
+	, claimed_(false)
 	, unblockedx_(-1)
+	, random_(static_cast<std::uint64_t>(
+		std::chrono::steady_clock::now().time_since_epoch().count()) ^
+		reinterpret_cast<std::uintptr_t>(this))
 {
-	std::srand(static_cast<unsigned int>(std::time(nullptr)));
+	if (random_ == 0)
+		random_ = 1;
 }
 
 ipc::context::~context(void)
 {
 }
 
-std::shared_ptr<ipc::context> ipc::context::get(void)
+// the context of whatever runs on this thread: a fiber's own while one
+// is switched in, otherwise the thread's, constructed on first use and
+// destroyed when the thread exits
+ipc::context* ipc::context::get(void)
 {
-	return context_.get();
+	if (current_ != nullptr)
+		return current_;
+	return &context_;
 }
 
-void ipc::context::add(ipc::channable* chan, void* data)
+// installs ctext as the one get returns, nullptr restoring the thread's;
+// returns the one installed before
+ipc::context* ipc::context::exchange(ipc::context* ctext)
 {
-	send_data_.push_back(std::make_pair(chan, data));
+	context* prev = current_;
+	current_ = ctext;
+	return prev;
 }
 
-void ipc::context::add(ipc::channable* chan)
+// data points at the value a sender offers, or at the raw storage a
+// receiver wants its value constructed in, so a rendezvous moves it
+// straight from one to the other; the nodes must not be linked into
+// any channel until every case has been added
+ipc::waiter* ipc::context::add(ipc::channable* chan, void* data,
+	const bool& recv)
 {
-	send_data_.push_back(std::make_pair(chan, nullptr));
+	send_data_.emplace_back(this, chan, data, recv,
+		static_cast<int>(send_data_.size()));
+	return &send_data_.back();
 }
 
 void ipc::context::add_to_all_channels(void)
 {
-	std::size_t size = send_data_.size();
-	for (std::size_t i = 0; i < size; i++)
+	for (auto& w: send_data_)
 	{
-		channable* ch = send_data_[i].first;
-		if (ch == nullptr)
+		if (w.chan == nullptr)
 			continue;
-		if (send_data_[i].second == nullptr)
-			ch->add_receiver(this->shared_from_this());
+		if (w.recv)
+			w.chan->add_receiver(&w);
 		else
-			ch->add_sender(this->shared_from_this());
+			w.chan->add_sender(&w);
 	}
 }
 
-void ipc::context::remove_from_all_channels(void)
+// with lock set the caller holds no channel locks and every channel is
+// locked on its own just long enough to unlink the node; the node that
+// woke us was already unlinked by the waker and is skipped outright
+void ipc::context::remove_from_all_channels(const bool& lock)
 {
-	std::size_t size = send_data_.size();
-	for (std::size_t i = 0; i < size; i++)
+	for (auto& w: send_data_)
 	{
-		channable* ch = send_data_[i].first;
-		if (ch == nullptr)
+		if (w.chan == nullptr)
 			continue;
-		if (send_data_[i].second == nullptr)
-			ch->remove_receiver(this->shared_from_this());
+		if (lock && w.index == unblockedx_)
+			continue;
+		if (lock)
+			w.chan->lock();
+		if (w.recv)
+			w.chan->remove_receiver(&w);
 		else
-			ch->remove_sender(this->shared_from_this());
+			w.chan->remove_sender(&w);
+		if (lock)
+			w.chan->unlock();
 	}
 }
 
 void ipc::context::clear(void)
 {
-	unblockedx_ = -1;
-	recv_data_ = nullptr;
 	send_data_.clear();
+	rearm();
+}
+
+void ipc::context::rearm(void)
+{
+	unblockedx_ = -1;
+	claimed_ = false;
+}
+
+// a waiting context can sit in the queues of several channels, each
+// guarded by its own lock, so the first channel to claim it wins and
+// every other channel skips it as stale
+bool ipc::context::claim(void)
+{
+	bool expected = false;
+	return claimed_.compare_exchange_strong(expected, true);
 }
 
 int ipc::context::get_unblocked_index(void) const
@@ -77,84 +130,105 @@ int ipc::context::get_unblocked_index(void) const
 	return unblockedx_;
 }
 
-void* ipc::context::get_receive_data(void) const
+void* ipc::context::unblocked_sender(ipc::waiter* w)
+{
+	unblockedx_ = w->index;
+	return w->data;
+}
+
+void* ipc::context::unblocked_receiver(ipc::waiter* w)
 {
-	return recv_data_;
+	unblockedx_ = w->index;
+	return w->data;
 }
 
-void* ipc::context::unblocked_sender(ipc::channable* chan)
+// a waiter that is still spinning sees the count go up on its own, the
+// semaphore only wakes one that has parked; channels call it with their
+// lock held, so an override must not block or take that lock again
+void ipc::context::signal(void)
 {
-	void* data = nullptr;
-	bool found = false;
-	std::size_t size = send_data_.size();
-	std::size_t i = std::rand() % size;
-	for (std::size_t n = 0; n < size; n++)
+	sem_.post();
+}
+
+void ipc::context::wait(void)
+{
+	if (!spin())
+		sem_.wait();
+}
+
+// when the deadline passes the context claims itself, so no channel can
+// pick it any more and the caller only has to unlink its nodes; if a
+// channel got there first its signal is already on the way and is
+// waited for, the operation then having gone through after all
+bool ipc::context::wait_until(
+	const std::chrono::steady_clock::time_point& deadline)
+{
+	if (spin(&deadline) || sem_.wait_until(deadline))
+		return true;
+	if (claim())
+		return false;
+	sem_.wait();
+	return true;
+}
+
+// bounds the spin phase of every later wait: up to max_spin pauses and
+// then up to max_yield yields before the thread parks
+void ipc::context::set_spin(const std::size_t& max_spin,
+	const std::size_t& max_yield)
+{
+	max_spin_ = max_spin;
+	max_yield_ = max_yield;
+}
+
+// spins for about twice as long as recent waits needed, so a peer that
+// answers within a few hundred nanoseconds is caught without a syscall
+// on either side, while waits that ended up parking shrink the budget.
+// a deadline cuts the spin short, looked at every so many pauses and
+// after every yield; one already passed only gets a look at the count
+bool ipc::context::spin(const std::chrono::steady_clock::time_point* deadline)
+{
+	if (deadline != nullptr && std::chrono::steady_clock::now() >= *deadline)
+		return sem_.try_wait();
+	std::size_t limit = std::min<std::size_t>(max_spin_, 2 * spin_ + 16);
+	for (std::size_t n = 0; n < limit; n++)
 	{
-		channable* ch = send_data_[i].first;
-		if (ch != nullptr)
+		if (deadline != nullptr && (n & 63) == 63 &&
+				std::chrono::steady_clock::now() >= *deadline)
+			return sem_.try_wait();
+		if (sem_.try_wait())
 		{
-			if (ch == chan && send_data_[i].second != nullptr && !found)
-			{
-				unblockedx_ = static_cast<int>(i);
-				data = send_data_[i].second;
-				found = true;
-			}
-			else if (send_data_[i].second == nullptr)
-				ch->remove_receiver(this->shared_from_this());
+			if (n > spin_)
+				spin_ += (n - spin_) / 8;
 			else
-				ch->remove_sender(this->shared_from_this());
+				spin_ -= (spin_ - n) / 8;
+			return true;
 		}
-		if (++i >= size)
-			i = 0;
+		IPC_PAUSE();
 	}
-	if (!found)
-		throw std::runtime_error("chan not found in context");
-	send_data_.clear();
-	return data;
-}
-
-void ipc::context::unblocked_receiver(ipc::channable* chan, void* data)
-{
-	bool found = false;
-	std::size_t size = send_data_.size();
-	std::size_t i = std::rand() % size;
-	for (std::size_t n = 0; n < size; n++)
+	std::size_t yields = max_yield_;
+	for (std::size_t n = 0; n < yields; n++)
 	{
-		channable* ch = send_data_[i].first;
-		if (ch != nullptr)
+		std::this_thread::yield();
+		if (sem_.try_wait())
 		{
-			if (ch == chan && send_data_[i].second == nullptr && !found)
-			{
-				unblockedx_ = static_cast<int>(i);
-				recv_data_ = data;
-				found = true;
-			}
-			else if (send_data_[i].second == nullptr)
-				ch->remove_receiver(this->shared_from_this());
-			else
-				ch->remove_sender(this->shared_from_this());
+			spin_ += (limit - std::min(limit, spin_)) / 8 + 1;
+			return true;
 		}
-		if (++i >= size)
-			i = 0;
+		if (deadline != nullptr && std::chrono::steady_clock::now() >= *deadline)
+			return false;
 	}
-	if (!found)
-		throw std::runtime_error("chan not found in context");
-	send_data_.clear();
-}
-
-void ipc::context::signal(void)
-{
-	std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
-	++count_;
-	cond_.notify_one();
+	spin_ -= spin_ / 8;
+	return false;
 }
 
-void ipc::context::wait(void)
+// xorshift, private to the thread; std::rand serialises every caller
+// on one lock and select draws from it on every call
+std::size_t ipc::context::random(void)
 {
-	std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
-	while (!count_)
-		cond_.wait(lock);
-	--count_;
+	random_ ^= random_ << 13;
+	random_ ^= random_ >> 7;
+	random_ ^= random_ << 17;
+	return static_cast<std::size_t>(random_);
 }
 
 std::size_t ipc::context::send_data_size(void) const
@@ -164,10 +238,15 @@ std::size_t ipc::context::send_data_size(void) const
 
 ipc::channable* ipc::context::send_data_channel(const int& i) const
 {
-	return send_data_[i].first;
+	return send_data_[i].chan;
 }
 
 void* ipc::context::send_data_data(const int& i) const
 {
-	return send_data_[i].second;
+	return send_data_[i].data;
+}
+
+bool ipc::context::send_data_recv(const int& i) const
+{
+	return send_data_[i].recv;
 }
@@ -1,61 +1,76 @@
 #ifndef __IPC_CONTEXT__
 #define __IPC_CONTEXT__
 
+#include <atomic>
 #include <memory>
 #include <vector>
-#include <mutex>
 #include <utility>
-#include <condition_variable>
+#include <cstdint>
+#include <chrono>
 
-#include "ipc.threadvar.h"
+#include "ipc.waitq.h"
+#include "ipc.semaphore.h"
 #include "ipc.noncopyable.h"
 
 namespace ipc
 {
 	struct channable;
 
-	class context : public noncopyable,
-			public std::enable_shared_from_this<context>
+	class context : public noncopyable
 	{
-		static threadvar<context> context_;
-		std::condition_variable cond_;
-		unsigned long count_;
+		static thread_local context context_;
+		static thread_local context* current_;
+		static std::atomic_size_t max_spin_;
+		static std::atomic_size_t max_yield_;
 
+		semaphore sem_;
+		std::size_t spin_;
+
+		std::atomic_bool claimed_;
 		int unblockedx_;
-		void* recv_data_;
 
-		std::vector<std::pair<channable*, void*>> send_data_;
-	public:
-		static std::mutex mutex;
+		std::uint64_t random_;
+
+		std::vector<waiter> send_data_;
 	public:
 		context(void);
 		virtual ~context(void);
 	public:
-		static std::shared_ptr<context> get(void);
+		static context* get(void);
+		static context* exchange(context* ctext);
 	public:
-		void add(channable* chan, void* data);
-		void add(channable* chan);
+		waiter* add(channable* chan, void* data, const bool& recv = false);
 	public:
 		void add_to_all_channels(void);
-		void remove_from_all_channels(void);
+		void remove_from_all_channels(const bool& lock = false);
 	public:
 		void clear(void);
+		void rearm(void);
+	public:
+		bool claim(void);
 	public:
 		int get_unblocked_index(void) const;
 	public:
-		void* get_receive_data(void) const;
+		void* unblocked_sender(waiter* w);
+		void* unblocked_receiver(waiter* w);
+	public:
+		virtual void signal(void);
+		virtual void wait(void);
+		virtual bool wait_until(
+			const std::chrono::steady_clock::time_point& deadline);
 	public:
-		void* unblocked_sender(channable* chan);
-		void unblocked_receiver(channable* chan, void* data);
+		static void set_spin(const std::size_t& max_spin,
+			const std::size_t& max_yield);
 	public:
-		void signal(void);
-		void wait(void);
+		std::size_t random(void);
+	private:
+		bool spin(const std::chrono::steady_clock::time_point* deadline = nullptr);
 	public:
 		std::size_t send_data_size(void) const;
 		channable* send_data_channel(const int& i) const;
 		void* send_data_data(const int& i) const;
+		bool send_data_recv(const int& i) const;
 	};
 }
 
 #endif
-
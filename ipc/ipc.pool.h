@@ -0,0 +1,67 @@
+#ifndef __IPC_POOL__
+#define __IPC_POOL__
+
+#include <vector>
+#include <cstddef>
+
+#include "ipc.ring.h"
+
+namespace ipc
+{
+	// per thread free list of raw slots for one element type, so values
+	// the selector keeps on the side stop reaching the allocator once a
+	// loop has warmed up
+	template <class T>
+	class pool
+	{
+		static constexpr std::size_t max_free = 64;
+
+		struct freelist
+		{
+			std::vector<slot<T>*> slots;
+			~freelist(void);
+		};
+
+		static freelist& local(void);
+	public:
+		static void* allocate(void);
+		static void deallocate(void* data);
+	};
+
+	template <class T>
+	pool<T>::freelist::~freelist(void)
+	{
+		for (auto p: slots)
+			delete p;
+	}
+
+	template <class T>
+	typename pool<T>::freelist& pool<T>::local(void)
+	{
+		static thread_local freelist list;
+		return list;
+	}
+
+	template <class T>
+	void* pool<T>::allocate(void)
+	{
+		freelist& list = local();
+		if (list.slots.empty())
+			return new slot<T>;
+		slot<T>* p = list.slots.back();
+		list.slots.pop_back();
+		return p;
+	}
+
+	template <class T>
+	void pool<T>::deallocate(void* data)
+	{
+		freelist& list = local();
+		if (list.slots.size() < max_free)
+			list.slots.push_back(static_cast<slot<T>*>(data));
+		else
+			delete static_cast<slot<T>*>(data);
+	}
+}
+
+#endif
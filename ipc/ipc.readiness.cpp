@@ -0,0 +1,73 @@
+#include "ipc.readiness.h"
+
+#include <stdexcept>
+#include <cstdint>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+ipc::readiness::readiness(void)
+	: fd_(-1)
+	, armed_(false)
+{
+}
+
+ipc::readiness::~readiness(void)
+{
+#if defined(__linux__)
+	int fd = fd_.load();
+	if (fd != -1)
+		::close(fd);
+#endif
+}
+
+// the fd starts out readable, so whoever polls it drains what was sent
+// before it existed; of two threads opening it at once one keeps its fd
+int ipc::readiness::fd(void)
+{
+#if defined(__linux__)
+	int fd = fd_.load();
+	if (fd != -1)
+		return fd;
+	int efd = ::eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (efd == -1)
+		throw std::runtime_error("eventfd failed");
+	if (!fd_.compare_exchange_strong(fd, efd))
+	{
+		::close(efd);
+		return fd;
+	}
+	return efd;
+#else
+	throw std::runtime_error("readiness fds need eventfd");
+#endif
+}
+
+bool ipc::readiness::opened(void) const
+{
+	return fd_.load(std::memory_order_relaxed) != -1;
+}
+
+// called after an operation found the channel not ready; the caller
+// fences and looks at the channel once more before it gives up
+void ipc::readiness::arm(void)
+{
+	armed_.store(true, std::memory_order_seq_cst);
+}
+
+// called after a change the other side is waiting for, behind a full
+// fence; only the first raise after an arm reaches the kernel
+void ipc::readiness::raise(void)
+{
+	if (!armed_.load(std::memory_order_relaxed))
+		return;
+	if (!armed_.exchange(false))
+		return;
+#if defined(__linux__)
+	std::uint64_t one = 1;
+	ssize_t rc = ::write(fd_.load(), &one, sizeof(one));
+	(void)rc;
+#endif
+}
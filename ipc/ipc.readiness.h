@@ -0,0 +1,32 @@
+#ifndef __IPC_READINESS__
+#define __IPC_READINESS__
+
+#include <atomic>
+
+#include "ipc.noncopyable.h"
+
+namespace ipc
+{
+	// an eventfd a channel raises when one side may go ahead again, so the
+	// channel can sit in an epoll set next to sockets. it is edge
+	// triggered: the fd is only raised once an operation on that side has
+	// failed to go ahead since the last raise, so the owner reads the fd
+	// and then drains the channel until a non blocking call fails. no fd
+	// is opened, and raising costs one load, until fd() is first called
+	class readiness : public noncopyable
+	{
+		std::atomic_int fd_;
+		std::atomic_bool armed_;
+	public:
+		readiness(void);
+		~readiness(void);
+	public:
+		int fd(void);
+		bool opened(void) const;
+	public:
+		void arm(void);
+		void raise(void);
+	};
+}
+
+#endif
@@ -0,0 +1,866 @@
+#ifndef __IPC_RING__
+#define __IPC_RING__
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <functional>
+#include <limits>
+#include <utility>
+#include <type_traits>
+#include <cstddef>
+#include <new>
+
+#include "ipc.noncopyable.h"
+
+namespace ipc
+{
+	constexpr std::size_t cache_line_size = 64;
+
+	constexpr std::size_t ceil_pow2(std::size_t n, std::size_t p = 1)
+	{
+		return p < n ? ceil_pow2(n, p << 1) : p;
+	}
+
+	// slots hold raw storage, values are constructed in place on push and
+	// moved out and destroyed on pop, so move only types ride the ring
+	// without ever being copied or default constructed
+	template <class T>
+	using slot = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+	// single producer, single consumer ring; the producer owns tail_ and
+	// the consumer owns head_, each on its own cache line together with a
+	// cached copy of the other side's index
+	template <class T>
+	class spsc_ring : public noncopyable
+	{
+		std::unique_ptr<slot<T>[]> buffer_;
+		std::size_t capacity_;
+		std::size_t mask_;
+
+		alignas(cache_line_size) std::atomic_size_t head_;
+		std::size_t tail_cache_;
+
+		alignas(cache_line_size) std::atomic_size_t tail_;
+		std::size_t head_cache_;
+	public:
+		spsc_ring(std::size_t size);
+		~spsc_ring(void);
+	public:
+		std::size_t capacity(void) const;
+		std::size_t size(void) const;
+		bool empty(void) const;
+		bool full(void) const;
+	public:
+		template <class... Args>
+		bool try_emplace(Args&&... args);
+		bool try_push(const T& data);
+		bool try_push(T&& data);
+		bool try_pop(T& data);
+	public:
+		void settle(void);
+	private:
+		T* at(const std::size_t& pos);
+	};
+
+	template <class T>
+	spsc_ring<T>::spsc_ring(std::size_t size)
+		: buffer_(size == 0 ? nullptr : new slot<T>[ceil_pow2(size)])
+		, capacity_(size)
+		, mask_(ceil_pow2(size) - 1)
+		, head_(0)
+		, tail_cache_(0)
+		, tail_(0)
+		, head_cache_(0)
+	{
+	}
+
+	template <class T>
+	spsc_ring<T>::~spsc_ring(void)
+	{
+		std::size_t tail = tail_.load(std::memory_order_acquire);
+		for (std::size_t pos = head_; pos != tail; pos++)
+			at(pos)->~T();
+	}
+
+	template <class T>
+	std::size_t spsc_ring<T>::capacity(void) const
+	{
+		return capacity_;
+	}
+
+	template <class T>
+	std::size_t spsc_ring<T>::size(void) const
+	{
+		std::size_t head = head_.load(std::memory_order_acquire);
+		return tail_.load(std::memory_order_acquire) - head;
+	}
+
+	template <class T>
+	bool spsc_ring<T>::empty(void) const
+	{
+		return size() == 0;
+	}
+
+	template <class T>
+	bool spsc_ring<T>::full(void) const
+	{
+		return size() >= capacity_;
+	}
+
+	template <class T>
+	template <class... Args>
+	bool spsc_ring<T>::try_emplace(Args&&... args)
+	{
+		std::size_t tail = tail_.load(std::memory_order_relaxed);
+		if (tail - head_cache_ >= capacity_)
+		{
+			head_cache_ = head_.load(std::memory_order_acquire);
+			if (tail - head_cache_ >= capacity_)
+				return false;
+		}
+		new (at(tail)) T(std::forward<Args>(args)...);
+		tail_.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	template <class T>
+	bool spsc_ring<T>::try_push(const T& data)
+	{
+		return try_emplace(data);
+	}
+
+	template <class T>
+	bool spsc_ring<T>::try_push(T&& data)
+	{
+		return try_emplace(std::move(data));
+	}
+
+	template <class T>
+	bool spsc_ring<T>::try_pop(T& data)
+	{
+		std::size_t head = head_.load(std::memory_order_relaxed);
+		if (head == tail_cache_)
+		{
+			tail_cache_ = tail_.load(std::memory_order_acquire);
+			if (head == tail_cache_)
+				return false;
+		}
+		T* p = at(head);
+		data = std::move(*p);
+		p->~T();
+		head_.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// nothing is ever recorded for later, see segmented_ring
+	template <class T>
+	void spsc_ring<T>::settle(void)
+	{
+	}
+
+	template <class T>
+	T* spsc_ring<T>::at(const std::size_t& pos)
+	{
+		return reinterpret_cast<T*>(&buffer_[pos & mask_]);
+	}
+
+	// a cell of an mpmc ring: the value's storage and the sequence that
+	// says whose turn it is
+	template <class T, class Pos = std::size_t>
+	struct ring_cell
+	{
+		std::atomic<Pos> seq;
+		slot<T> data;
+	};
+
+	// cells on the heap, as many as given at run time rounded up to a
+	// power of two; an unbuffered channel's ring of size 0 allocates
+	// nothing
+	template <class T>
+	struct heap_cells
+	{
+		typedef std::size_t pos_type;
+		typedef ring_cell<T> cell;
+
+		std::unique_ptr<cell[]> buffer;
+		std::size_t capacity;
+		std::size_t mask;
+
+		alignas(cache_line_size) std::atomic_size_t enqueue_pos;
+		alignas(cache_line_size) std::atomic_size_t dequeue_pos;
+	public:
+		heap_cells(std::size_t size);
+	};
+
+	template <class T>
+	heap_cells<T>::heap_cells(std::size_t size)
+		: buffer(size == 0 ? nullptr : new cell[ceil_pow2(size)])
+		, capacity(size == 0 ? 0 : ceil_pow2(size))
+		, mask(capacity - 1)
+		, enqueue_pos(0)
+		, dequeue_pos(0)
+	{
+		for (std::size_t i = 0; i < capacity; i++)
+			buffer[i].seq.store(2 * i, std::memory_order_relaxed);
+	}
+
+	// cells inline, their count fixed at compile time and rounded up to a
+	// power of two; a small channel then needs no heap buffer and no
+	// pointer to chase to reach it
+	template <class T, std::size_t N>
+	struct inline_cells
+	{
+		static_assert(N > 0, "a fixed ring needs room for at least one value");
+
+		typedef std::size_t pos_type;
+		typedef ring_cell<T> cell;
+
+		static constexpr std::size_t capacity = ceil_pow2(N);
+		static constexpr std::size_t mask = capacity - 1;
+
+		alignas(cache_line_size) cell buffer[capacity];
+
+		alignas(cache_line_size) std::atomic_size_t enqueue_pos;
+		alignas(cache_line_size) std::atomic_size_t dequeue_pos;
+	public:
+		inline_cells(std::size_t);
+	};
+
+	// the size is what basic_channel passes on, the capacity being N
+	template <class T, std::size_t N>
+	inline_cells<T, N>::inline_cells(std::size_t)
+		: enqueue_pos(0)
+		, dequeue_pos(0)
+	{
+		for (std::size_t i = 0; i < capacity; i++)
+			buffer[i].seq.store(2 * i, std::memory_order_relaxed);
+	}
+
+	// bounded multi producer, multi consumer ring after Vyukov; every cell
+	// carries a sequence number that tells producers and consumers whose
+	// turn it is, so neither side ever takes a lock. the sequence is 2*pos
+	// while the cell waits for the value at pos and 2*pos+1 once it holds
+	// it, which keeps full and free apart even for a single cell. the size
+	// is a power of two, so a position maps to its cell with a mask rather
+	// than a division; producers and consumers each own a position on a
+	// line of its own, and the size is derived from the two. Cells holds
+	// the cells and the positions and sets them up: on the heap, inline,
+	// or in a shared memory segment for shm_channel
+	template <class T, class Cells>
+	class basic_mpmc_ring : public noncopyable
+	{
+		typedef typename Cells::pos_type pos_type;
+		typedef typename std::make_signed<pos_type>::type diff_type;
+		typedef typename Cells::cell cell;
+
+		Cells cells_;
+	public:
+		template <class... Args>
+		basic_mpmc_ring(Args&&... args);
+		~basic_mpmc_ring(void);
+	public:
+		std::size_t capacity(void) const;
+		std::size_t size(void) const;
+		bool empty(void) const;
+		bool full(void) const;
+	public:
+		template <class... Args>
+		bool try_emplace(Args&&... args);
+		bool try_push(const T& data);
+		bool try_push(T&& data);
+		bool try_pop(T& data);
+	public:
+		void settle(void);
+	};
+
+	template <class T>
+	using mpmc_ring = basic_mpmc_ring<T, heap_cells<T>>;
+
+	template <class T, std::size_t N>
+	using fixed_ring = basic_mpmc_ring<T, inline_cells<T, N>>;
+
+	template <class T, class Cells>
+	template <class... Args>
+	basic_mpmc_ring<T, Cells>::basic_mpmc_ring(Args&&... args)
+		: cells_(std::forward<Args>(args)...)
+	{
+	}
+
+	template <class T, class Cells>
+	basic_mpmc_ring<T, Cells>::~basic_mpmc_ring(void)
+	{
+		if (std::is_trivially_destructible<T>::value)
+			return;
+		pos_type tail = cells_.enqueue_pos.load(std::memory_order_acquire);
+		for (pos_type pos = cells_.dequeue_pos; pos != tail; pos++)
+			reinterpret_cast<T*>(&cells_.buffer[pos & cells_.mask].data)->~T();
+	}
+
+	template <class T, class Cells>
+	std::size_t basic_mpmc_ring<T, Cells>::capacity(void) const
+	{
+		return cells_.capacity;
+	}
+
+	template <class T, class Cells>
+	std::size_t basic_mpmc_ring<T, Cells>::size(void) const
+	{
+		pos_type head = cells_.dequeue_pos.load(std::memory_order_acquire);
+		pos_type size = cells_.enqueue_pos.load(std::memory_order_acquire) - head;
+		return size > cells_.capacity ? cells_.capacity :
+			static_cast<std::size_t>(size);
+	}
+
+	template <class T, class Cells>
+	bool basic_mpmc_ring<T, Cells>::empty(void) const
+	{
+		return size() == 0;
+	}
+
+	template <class T, class Cells>
+	bool basic_mpmc_ring<T, Cells>::full(void) const
+	{
+		return size() >= cells_.capacity;
+	}
+
+	template <class T, class Cells>
+	template <class... Args>
+	bool basic_mpmc_ring<T, Cells>::try_emplace(Args&&... args)
+	{
+		if (cells_.capacity == 0)
+			return false;
+		cell* c;
+		pos_type pos = cells_.enqueue_pos.load(std::memory_order_relaxed);
+		while (true)
+		{
+			c = &cells_.buffer[pos & cells_.mask];
+			pos_type seq = c->seq.load(std::memory_order_acquire);
+			diff_type dif = static_cast<diff_type>(seq - 2 * pos);
+			if (dif == 0)
+			{
+				if (cells_.enqueue_pos.compare_exchange_weak(pos, pos + 1,
+						std::memory_order_relaxed))
+					break;
+			}
+			else if (dif < 0)
+				return false;
+			else
+				pos = cells_.enqueue_pos.load(std::memory_order_relaxed);
+		}
+		new (&c->data) T(std::forward<Args>(args)...);
+		c->seq.store(2 * pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	template <class T, class Cells>
+	bool basic_mpmc_ring<T, Cells>::try_push(const T& data)
+	{
+		return try_emplace(data);
+	}
+
+	template <class T, class Cells>
+	bool basic_mpmc_ring<T, Cells>::try_push(T&& data)
+	{
+		return try_emplace(std::move(data));
+	}
+
+	template <class T, class Cells>
+	bool basic_mpmc_ring<T, Cells>::try_pop(T& data)
+	{
+		if (cells_.capacity == 0)
+			return false;
+		cell* c;
+		pos_type pos = cells_.dequeue_pos.load(std::memory_order_relaxed);
+		while (true)
+		{
+			c = &cells_.buffer[pos & cells_.mask];
+			pos_type seq = c->seq.load(std::memory_order_acquire);
+			diff_type dif = static_cast<diff_type>(seq - (2 * pos + 1));
+			if (dif == 0)
+			{
+				if (cells_.dequeue_pos.compare_exchange_weak(pos, pos + 1,
+						std::memory_order_relaxed))
+					break;
+			}
+			else if (dif < 0)
+				return false;
+			else
+				pos = cells_.dequeue_pos.load(std::memory_order_relaxed);
+		}
+		T* p = reinterpret_cast<T*>(&c->data);
+		data = std::move(*p);
+		p->~T();
+		c->seq.store(2 * (pos + cells_.capacity), std::memory_order_release);
+		return true;
+	}
+
+	// nothing is ever recorded for later, see segmented_ring
+	template <class T, class Cells>
+	void basic_mpmc_ring<T, Cells>::settle(void)
+	{
+	}
+
+	// an unbounded ring of fixed size segments linked as the backlog grows;
+	// drained segments go to a short free list and anything beyond it back
+	// to the allocator, so memory follows the backlog both ways. a push
+	// only fails when the allocator throws, so a channel over it never
+	// blocks a sender. both ends share one short lock, segments changing
+	// hands too rarely for a lock free scheme to pay off. the size
+	// reaching high_water is recorded, and not again until it has dropped
+	// back below it; a push may run under the lock of the channel over
+	// the ring, and of every other channel of a select, so on_high_water
+	// is only called from settle, which the channel calls once it holds
+	// no lock
+	template <class T, std::size_t S = 64>
+	class segmented_ring : public noncopyable
+	{
+		static constexpr std::size_t max_free = 2;
+
+		struct segment
+		{
+			segment* next;
+			slot<T> data[S];
+		};
+
+		segment* head_;
+		std::size_t headx_;
+		segment* tail_;
+		std::size_t tailx_;
+
+		segment* free_;
+		std::size_t nfree_;
+
+		std::atomic_size_t size_;
+
+		std::size_t high_water_;
+		bool above_;
+		std::function<void(std::size_t)> on_high_water_;
+		std::atomic_size_t reached_;
+
+		std::mutex mutex_;
+	public:
+		segmented_ring(std::size_t size = 0);
+		~segmented_ring(void);
+	public:
+		void set_high_water(const std::size_t& high_water,
+			const std::function<void(std::size_t)>& on_high_water);
+	public:
+		std::size_t capacity(void) const;
+		std::size_t size(void) const;
+		bool empty(void) const;
+		bool full(void) const;
+	public:
+		template <class... Args>
+		bool try_emplace(Args&&... args);
+		bool try_push(const T& data);
+		bool try_push(T&& data);
+		bool try_pop(T& data);
+	public:
+		void settle(void);
+	private:
+		segment* acquire(void);
+		void release(segment* seg);
+	};
+
+	// size is what basic_channel passes on, there being no bound
+	template <class T, std::size_t S>
+	segmented_ring<T, S>::segmented_ring(std::size_t)
+		: head_(nullptr)
+		, headx_(0)
+		, tail_(nullptr)
+		, tailx_(0)
+		, free_(nullptr)
+		, nfree_(0)
+		, size_(0)
+		, high_water_(0)
+		, above_(false)
+		, reached_(0)
+	{
+	}
+
+	template <class T, std::size_t S>
+	segmented_ring<T, S>::~segmented_ring(void)
+	{
+		while (head_ != nullptr)
+		{
+			std::size_t end = head_ == tail_ ? tailx_ : S;
+			for (std::size_t i = headx_; i < end; i++)
+				reinterpret_cast<T*>(&head_->data[i])->~T();
+			segment* next = head_->next;
+			delete head_;
+			head_ = next;
+			headx_ = 0;
+		}
+		while (free_ != nullptr)
+		{
+			segment* next = free_->next;
+			delete free_;
+			free_ = next;
+		}
+	}
+
+	// a mark of 0 turns the callback off
+	template <class T, std::size_t S>
+	void segmented_ring<T, S>::set_high_water(const std::size_t& high_water,
+		const std::function<void(std::size_t)>& on_high_water)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		high_water_ = high_water;
+		on_high_water_ = on_high_water;
+		above_ = false;
+		reached_.store(0, std::memory_order_relaxed);
+	}
+
+	template <class T, std::size_t S>
+	std::size_t segmented_ring<T, S>::capacity(void) const
+	{
+		return std::numeric_limits<std::size_t>::max();
+	}
+
+	template <class T, std::size_t S>
+	std::size_t segmented_ring<T, S>::size(void) const
+	{
+		return size_.load(std::memory_order_acquire);
+	}
+
+	template <class T, std::size_t S>
+	bool segmented_ring<T, S>::empty(void) const
+	{
+		return size() == 0;
+	}
+
+	template <class T, std::size_t S>
+	bool segmented_ring<T, S>::full(void) const
+	{
+		return false;
+	}
+
+	template <class T, std::size_t S>
+	template <class... Args>
+	bool segmented_ring<T, S>::try_emplace(Args&&... args)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (tail_ == nullptr || tailx_ == S)
+		{
+			segment* seg = acquire();
+			if (tail_ == nullptr)
+				head_ = seg;
+			else
+				tail_->next = seg;
+			tail_ = seg;
+			tailx_ = 0;
+		}
+		new (&tail_->data[tailx_]) T(std::forward<Args>(args)...);
+		tailx_++;
+		std::size_t size = size_.load(std::memory_order_relaxed) + 1;
+		size_.store(size, std::memory_order_release);
+		if (high_water_ != 0 && size >= high_water_ && !above_)
+		{
+			above_ = true;
+			reached_.store(size, std::memory_order_release);
+		}
+		return true;
+	}
+
+	template <class T, std::size_t S>
+	bool segmented_ring<T, S>::try_push(const T& data)
+	{
+		return try_emplace(data);
+	}
+
+	template <class T, std::size_t S>
+	bool segmented_ring<T, S>::try_push(T&& data)
+	{
+		return try_emplace(std::move(data));
+	}
+
+	// once empty the ring starts over at the front of its one segment
+	template <class T, std::size_t S>
+	bool segmented_ring<T, S>::try_pop(T& data)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::size_t size = size_.load(std::memory_order_relaxed);
+		if (size == 0)
+			return false;
+		if (headx_ == S)
+		{
+			segment* seg = head_;
+			head_ = head_->next;
+			headx_ = 0;
+			release(seg);
+		}
+		T* p = reinterpret_cast<T*>(&head_->data[headx_]);
+		data = std::move(*p);
+		p->~T();
+		headx_++;
+		size_.store(--size, std::memory_order_release);
+		if (size == 0)
+		{
+			headx_ = 0;
+			tailx_ = 0;
+		}
+		if (size < high_water_)
+			above_ = false;
+		return true;
+	}
+
+	// calls on_high_water for a mark reached since the last call, on
+	// whichever thread gets here first
+	template <class T, std::size_t S>
+	void segmented_ring<T, S>::settle(void)
+	{
+		if (reached_.load(std::memory_order_acquire) == 0)
+			return;
+		std::size_t size;
+		std::function<void(std::size_t)> fire;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			size = reached_.exchange(0, std::memory_order_relaxed);
+			fire = on_high_water_;
+		}
+		if (size != 0 && fire)
+			fire(size);
+	}
+
+	template <class T, std::size_t S>
+	typename segmented_ring<T, S>::segment* segmented_ring<T, S>::acquire(void)
+	{
+		segment* seg = free_;
+		if (seg != nullptr)
+		{
+			free_ = seg->next;
+			nfree_--;
+		}
+		else
+			seg = new segment;
+		seg->next = nullptr;
+		return seg;
+	}
+
+	template <class T, std::size_t S>
+	void segmented_ring<T, S>::release(segment* seg)
+	{
+		if (nfree_ >= max_free)
+		{
+			delete seg;
+			return;
+		}
+		seg->next = free_;
+		free_ = seg;
+		nfree_++;
+	}
+
+	// a ring per priority level, 0 the highest, each value going to the
+	// level level_of gives it and a pop always taking from the highest
+	// level that has one, in order within a level. the capacity is shared:
+	// full means full for every level, which is what lets a channel over
+	// it park and wake senders without knowing their levels. both ends
+	// share one short lock, a pop having to see every level at once
+	template <class T>
+	class priority_ring : public noncopyable
+	{
+		struct lane
+		{
+			std::unique_ptr<slot<T>[]> data;
+			std::size_t head;
+			std::size_t size;
+		};
+
+		std::vector<lane> levels_;
+		std::size_t capacity_;
+		std::function<std::size_t(const T&)> level_of_;
+
+		std::atomic_size_t size_;
+
+		std::mutex mutex_;
+	public:
+		priority_ring(std::size_t size);
+		~priority_ring(void);
+	public:
+		void set_levels(const std::size_t& levels,
+			const std::function<std::size_t(const T&)>& level_of);
+	public:
+		std::size_t capacity(void) const;
+		std::size_t size(void) const;
+		bool empty(void) const;
+		bool full(void) const;
+	public:
+		template <class... Args>
+		bool try_emplace(Args&&... args);
+		bool try_push(const T& data);
+		bool try_push(T&& data);
+		bool try_pop(T& data);
+	public:
+		void settle(void);
+	private:
+		std::size_t level(const T& data) const;
+		void place(const std::size_t& i, T&& data);
+		void clear(void);
+	};
+
+	// one level until set_levels says otherwise
+	template <class T>
+	priority_ring<T>::priority_ring(std::size_t size)
+		: capacity_(size)
+		, size_(0)
+	{
+		set_levels(1, nullptr);
+	}
+
+	template <class T>
+	priority_ring<T>::~priority_ring(void)
+	{
+		clear();
+	}
+
+	// only while the ring is not yet in use; a level past the last one
+	// counts as the last one
+	template <class T>
+	void priority_ring<T>::set_levels(const std::size_t& levels,
+		const std::function<std::size_t(const T&)>& level_of)
+	{
+		clear();
+		levels_.clear();
+		levels_.resize(levels == 0 ? 1 : levels);
+		for (auto& l: levels_)
+		{
+			if (capacity_ != 0)
+				l.data.reset(new slot<T>[capacity_]);
+			l.head = 0;
+			l.size = 0;
+		}
+		level_of_ = level_of;
+	}
+
+	template <class T>
+	std::size_t priority_ring<T>::capacity(void) const
+	{
+		return capacity_;
+	}
+
+	template <class T>
+	std::size_t priority_ring<T>::size(void) const
+	{
+		return size_.load(std::memory_order_acquire);
+	}
+
+	template <class T>
+	bool priority_ring<T>::empty(void) const
+	{
+		return size() == 0;
+	}
+
+	template <class T>
+	bool priority_ring<T>::full(void) const
+	{
+		return size() >= capacity_;
+	}
+
+	// args are left alone unless there is room, so the value is built
+	// under the lock and asked for its level there
+	template <class T>
+	template <class... Args>
+	bool priority_ring<T>::try_emplace(Args&&... args)
+	{
+		if (full())
+			return false;
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (size_.load(std::memory_order_relaxed) >= capacity_)
+			return false;
+		T data(std::forward<Args>(args)...);
+		place(level(data), std::move(data));
+		return true;
+	}
+
+	template <class T>
+	bool priority_ring<T>::try_push(const T& data)
+	{
+		return try_emplace(data);
+	}
+
+	// a value that does not fit is left as it was, the channel keeping
+	// it for a later try
+	template <class T>
+	bool priority_ring<T>::try_push(T&& data)
+	{
+		if (full())
+			return false;
+		std::size_t i = level(data);
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (size_.load(std::memory_order_relaxed) >= capacity_)
+			return false;
+		place(i, std::move(data));
+		return true;
+	}
+
+	template <class T>
+	bool priority_ring<T>::try_pop(T& data)
+	{
+		if (empty())
+			return false;
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::size_t size = size_.load(std::memory_order_relaxed);
+		if (size == 0)
+			return false;
+		for (auto& l: levels_)
+		{
+			if (l.size == 0)
+				continue;
+			T* p = reinterpret_cast<T*>(&l.data[l.head]);
+			data = std::move(*p);
+			p->~T();
+			if (++l.head == capacity_)
+				l.head = 0;
+			l.size--;
+			size_.store(size - 1, std::memory_order_release);
+			return true;
+		}
+		return false;
+	}
+
+	// nothing is ever recorded for later, see segmented_ring
+	template <class T>
+	void priority_ring<T>::settle(void)
+	{
+	}
+
+	template <class T>
+	std::size_t priority_ring<T>::level(const T& data) const
+	{
+		std::size_t i = level_of_ ? level_of_(data) : 0;
+		return i < levels_.size() ? i : levels_.size() - 1;
+	}
+
+	// called with the lock held and room in the ring
+	template <class T>
+	void priority_ring<T>::place(const std::size_t& i, T&& data)
+	{
+		lane& l = levels_[i];
+		std::size_t tail = l.head + l.size;
+		if (tail >= capacity_)
+			tail -= capacity_;
+		new (&l.data[tail]) T(std::move(data));
+		l.size++;
+		size_.store(size_.load(std::memory_order_relaxed) + 1,
+			std::memory_order_release);
+	}
+
+	template <class T>
+	void priority_ring<T>::clear(void)
+	{
+		for (auto& l: levels_)
+		{
+			for (; l.size != 0; l.size--)
+			{
+				reinterpret_cast<T*>(&l.data[l.head])->~T();
+				if (++l.head == capacity_)
+					l.head = 0;
+			}
+		}
+		size_.store(0, std::memory_order_relaxed);
+	}
+}
+
+#endif
@@ -0,0 +1,604 @@
+#include "ipc.runtime.h"
+#include "ipc.context.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <exception>
+#include <thread>
+#include <cstdint>
+
+#if defined(_WIN32)
+#include <windows.h>
+#define IPC_NOINLINE __declspec(noinline)
+#else
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define IPC_NOINLINE __attribute__((noinline))
+#endif
+
+namespace
+{
+	enum action { none, park, done };
+
+	const std::size_t max_free = 1024;
+	const std::size_t stack_chunk = 4 * 1024 * 1024;
+}
+
+struct ipc::runtime::worker
+{
+	runtime* rt;
+	std::deque<fiber*> queue;
+	std::mutex mutex;
+	std::thread thread;
+	std::size_t victim;
+	std::size_t runs;
+	action after;
+#if defined(_WIN32)
+	void* handle;
+#else
+	ucontext_t ctx;
+#endif
+};
+
+// fiber stacks, each a slot of a larger mapping so that a runtime with
+// hundreds of thousands of fibers needs a few thousand mappings rather
+// than one per fiber; a slot starts with the guard page when there is
+// one. a stack given back has its pages dropped, so memory follows the
+// fibers alive, the mappings themselves staying until the runtime goes
+struct ipc::runtime::stack_pool
+{
+	std::size_t size;
+	std::size_t page;
+	bool guard;
+	std::vector<std::pair<void*, std::size_t>> chunks;
+	std::vector<void*> free;
+	std::mutex mutex;
+public:
+	stack_pool(const std::size_t& stack_size, const bool& guard);
+	~stack_pool(void);
+public:
+	void* acquire(void);
+	void release(void* stack);
+};
+
+// a fiber is a context of its own: channels park it and wake it through
+// the same calls as a thread, only waiting switches back to the worker
+// instead of blocking it. count_ holds the wakes not yet waited for, or
+// -1 while the fiber is parked and in nobody's queue
+class ipc::fiber : public ipc::context
+{
+	runtime* rt_;
+	std::function<void(void)> fn_;
+	std::atomic_int count_;
+	std::multimap<std::chrono::steady_clock::time_point, fiber*>::iterator timer_;
+	bool timed_;
+#if defined(_WIN32)
+	void* handle_;
+#else
+	ucontext_t ctx_;
+	void* stack_;
+	std::size_t stack_size_;
+#endif
+public:
+	fiber(runtime* rt, const std::size_t& stack_size);
+	virtual ~fiber(void);
+public:
+	void start(const std::function<void(void)>& fn);
+	void resume(runtime::worker* w);
+	void parked(void);
+public:
+	virtual void signal(void);
+	virtual void wait(void);
+	virtual bool wait_until(const std::chrono::steady_clock::time_point& deadline);
+private:
+	friend class runtime;
+private:
+	void main(void);
+	void suspend(const action& after);
+private:
+	static runtime::worker* this_worker(void);
+#if defined(_WIN32)
+	static void __stdcall entry(void* param);
+#else
+	static void entry(unsigned int hi, unsigned int lo);
+#endif
+};
+
+thread_local ipc::runtime::worker* ipc::runtime::current_ = nullptr;
+
+#if defined(_WIN32)
+
+ipc::fiber::fiber(ipc::runtime* rt, const std::size_t& stack_size)
+	: rt_(rt)
+	, count_(0)
+	, timed_(false)
+	, handle_(::CreateFiber(stack_size, &fiber::entry, this))
+{
+	if (handle_ == nullptr)
+		throw std::runtime_error("fiber could not be created");
+}
+
+ipc::fiber::~fiber(void)
+{
+	::DeleteFiber(handle_);
+}
+
+void __stdcall ipc::fiber::entry(void* param)
+{
+	fiber* f = static_cast<fiber*>(param);
+	while (true)
+		f->main();
+}
+
+#else
+
+// the stack comes from the runtime's pool, its guard page, if any,
+// included in stack_size_
+ipc::fiber::fiber(ipc::runtime* rt, const std::size_t&)
+	: rt_(rt)
+	, count_(0)
+	, timed_(false)
+	, stack_(rt->stacks_->acquire())
+	, stack_size_(rt->stacks_->size)
+{
+	::getcontext(&ctx_);
+	ctx_.uc_stack.ss_sp = stack_;
+	ctx_.uc_stack.ss_size = stack_size_;
+	ctx_.uc_link = nullptr;
+	std::uintptr_t p = reinterpret_cast<std::uintptr_t>(this);
+	::makecontext(&ctx_, reinterpret_cast<void (*)(void)>(&fiber::entry), 2,
+		static_cast<unsigned int>(static_cast<std::uint64_t>(p) >> 32),
+		static_cast<unsigned int>(p));
+}
+
+ipc::fiber::~fiber(void)
+{
+	rt_->stacks_->release(stack_);
+}
+
+void ipc::fiber::entry(unsigned int hi, unsigned int lo)
+{
+	fiber* f = reinterpret_cast<fiber*>(static_cast<std::uintptr_t>(
+		(static_cast<std::uint64_t>(hi) << 32) | lo));
+	while (true)
+		f->main();
+}
+
+#endif
+
+// a fiber is reused once it is done, its entry looping back into main
+// the next time it is switched in
+void ipc::fiber::start(const std::function<void(void)>& fn)
+{
+	fn_ = fn;
+}
+
+// what was captured is released on the fiber too, where it may block
+void ipc::fiber::main(void)
+{
+	try
+	{
+		fn_();
+		fn_ = nullptr;
+	}
+	catch (...)
+	{
+		std::terminate();
+	}
+	suspend(done);
+}
+
+void ipc::fiber::resume(ipc::runtime::worker* w)
+{
+	w->after = none;
+	context* prev = context::exchange(this);
+#if defined(_WIN32)
+	::SwitchToFiber(handle_);
+#else
+	::swapcontext(&w->ctx, &ctx_);
+#endif
+	context::exchange(prev);
+}
+
+// the worker may differ from the one before the last switch, so it is
+// looked up afresh every time, never through a cached thread local
+void ipc::fiber::suspend(const action& after)
+{
+	runtime::worker* w = this_worker();
+	w->after = after;
+#if defined(_WIN32)
+	::SwitchToFiber(w->handle);
+#else
+	::swapcontext(&ctx_, &w->ctx);
+#endif
+}
+
+IPC_NOINLINE ipc::runtime::worker* ipc::fiber::this_worker(void)
+{
+	return runtime::current_;
+}
+
+// called by the worker once it has switched away from the fiber; a wake
+// that came in meanwhile queues it straight away
+void ipc::fiber::parked(void)
+{
+	if (count_.fetch_sub(1) > 0)
+		rt_->ready(this);
+}
+
+void ipc::fiber::signal(void)
+{
+	if (count_.fetch_add(1) == -1)
+		rt_->ready(this);
+}
+
+void ipc::fiber::wait(void)
+{
+	int count = count_.load();
+	while (count > 0)
+		if (count_.compare_exchange_weak(count, count - 1))
+			return;
+	suspend(park);
+}
+
+// the timer wakes the fiber like a channel would; once it has fired a
+// claim decides, as for a thread, and a channel that got there first
+// is waited for, its wake being the second one on the way
+bool ipc::fiber::wait_until(
+	const std::chrono::steady_clock::time_point& deadline)
+{
+	rt_->add_timer(this, deadline);
+	wait();
+	if (rt_->cancel_timer(this))
+		return true;
+	if (claim())
+		return false;
+	wait();
+	return true;
+}
+
+#if defined(_WIN32)
+
+// CreateFiber allocates every stack, with a guard page of its own
+ipc::runtime::stack_pool::stack_pool(const std::size_t& stack_size,
+	const bool& guard)
+	: size(stack_size)
+	, page(0)
+	, guard(guard)
+{
+}
+
+ipc::runtime::stack_pool::~stack_pool(void)
+{
+}
+
+#else
+
+// untouched pages of a mapping cost nothing, and MAP_NORESERVE keeps
+// them from counting against overcommit until a fiber touches them
+ipc::runtime::stack_pool::stack_pool(const std::size_t& stack_size,
+	const bool& guard)
+	: page(static_cast<std::size_t>(::sysconf(_SC_PAGESIZE)))
+	, guard(guard)
+{
+	size = (stack_size + page - 1) / page * page + (guard ? page : 0);
+}
+
+ipc::runtime::stack_pool::~stack_pool(void)
+{
+	for (auto& c: chunks)
+		::munmap(c.first, c.second);
+}
+
+void* ipc::runtime::stack_pool::acquire(void)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (free.empty())
+	{
+		std::size_t n = std::max<std::size_t>(1, stack_chunk / size);
+		void* p = ::mmap(nullptr, n * size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (p == MAP_FAILED)
+			throw std::runtime_error("fiber stack could not be mapped");
+		char* base = static_cast<char*>(p);
+		for (std::size_t i = 0; guard && i < n; i++)
+			if (::mprotect(base + i * size, page, PROT_NONE) != 0)
+			{
+				::munmap(p, n * size);
+				throw std::runtime_error("fiber stack guard could not be set");
+			}
+		chunks.emplace_back(p, n * size);
+		for (std::size_t i = n; i > 0; i--)
+			free.push_back(base + (i - 1) * size);
+	}
+	void* stack = free.back();
+	free.pop_back();
+	return stack;
+}
+
+void ipc::runtime::stack_pool::release(void* stack)
+{
+	std::size_t skip = guard ? page : 0;
+	::madvise(static_cast<char*>(stack) + skip, size - skip, MADV_DONTNEED);
+	std::lock_guard<std::mutex> lock(mutex);
+	free.push_back(stack);
+}
+
+#endif
+
+ipc::runtime::runtime(const std::size_t& threads, const std::size_t& stack_size,
+	const bool& guard)
+	: stack_size_(stack_size)
+	, pending_(0)
+	, idle_(0)
+	, stop_(false)
+	, live_(0)
+	, stacks_(new stack_pool(stack_size, guard))
+{
+	std::size_t n = threads;
+	if (n == 0)
+		n = std::thread::hardware_concurrency();
+	if (n == 0)
+		n = 1;
+	for (std::size_t i = 0; i < n; i++)
+	{
+		workers_.emplace_back(new worker);
+		workers_.back()->rt = this;
+		workers_.back()->victim = i + 1;
+		workers_.back()->runs = 0;
+	}
+	for (auto& w: workers_)
+		w->thread = std::thread(&runtime::run, this, w.get());
+}
+
+// fibers still parked when the runtime goes away are abandoned, their
+// stacks are never unwound
+ipc::runtime::~runtime(void)
+{
+	stop_ = true;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		cond_.notify_all();
+	}
+	for (auto& w: workers_)
+		w->thread.join();
+	for (auto& w: workers_)
+		for (auto f: w->queue)
+			delete f;
+	for (auto f: inject_)
+		delete f;
+	for (auto f: free_)
+		delete f;
+}
+
+ipc::runtime* ipc::runtime::get(void)
+{
+	static runtime rt;
+	return &rt;
+}
+
+std::size_t ipc::runtime::size(void) const
+{
+	return workers_.size();
+}
+
+void ipc::runtime::go(const std::function<void(void)>& fn)
+{
+	fiber* f = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(free_mutex_);
+		if (!free_.empty())
+		{
+			f = free_.back();
+			free_.pop_back();
+		}
+	}
+	if (f == nullptr)
+		f = new fiber(this, stack_size_);
+	f->start(fn);
+	live_++;
+	ready(f);
+}
+
+// blocks the calling thread, which must not be one of the workers, until
+// every fiber has run to its end
+void ipc::runtime::wait(void)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (live_ != 0)
+		done_.wait(lock);
+}
+
+// a fiber made ready on a worker goes to that worker's queue, one made
+// ready anywhere else to the shared one; either way an idle worker is
+// woken to take it. pending_ and idle_ pair up like a channel's ring and
+// waiter count, so a worker going idle either sees the fiber or is seen
+void ipc::runtime::ready(ipc::fiber* f)
+{
+	worker* w = current_;
+	if (w != nullptr && w->rt == this)
+	{
+		std::lock_guard<std::mutex> lock(w->mutex);
+		w->queue.push_back(f);
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(inject_mutex_);
+		inject_.push_back(f);
+	}
+	pending_++;
+	if (idle_ != 0)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		cond_.notify_one();
+	}
+}
+
+// its own queue first, then the shared one, then half of the queue of
+// another worker, trying each in turn starting after the last victim
+ipc::fiber* ipc::runtime::next(ipc::runtime::worker* w)
+{
+	{
+		std::lock_guard<std::mutex> lock(w->mutex);
+		if (!w->queue.empty())
+		{
+			fiber* f = w->queue.front();
+			w->queue.pop_front();
+			pending_--;
+			return f;
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lock(inject_mutex_);
+		if (!inject_.empty())
+		{
+			fiber* f = inject_.front();
+			inject_.pop_front();
+			pending_--;
+			return f;
+		}
+	}
+	std::size_t n = workers_.size();
+	for (std::size_t k = 0; k < n; k++)
+	{
+		worker* v = workers_[w->victim++ % n].get();
+		if (v == w)
+			continue;
+		std::vector<fiber*> loot;
+		{
+			std::lock_guard<std::mutex> lock(v->mutex);
+			std::size_t take = (v->queue.size() + 1) / 2;
+			for (std::size_t i = 0; i < take; i++)
+			{
+				loot.push_back(v->queue.front());
+				v->queue.pop_front();
+			}
+		}
+		if (loot.empty())
+			continue;
+		if (loot.size() > 1)
+		{
+			std::lock_guard<std::mutex> lock(w->mutex);
+			w->queue.insert(w->queue.end(), loot.begin() + 1, loot.end());
+		}
+		pending_--;
+		return loot.front();
+	}
+	return nullptr;
+}
+
+void ipc::runtime::run(ipc::runtime::worker* w)
+{
+	current_ = w;
+#if defined(_WIN32)
+	w->handle = ::ConvertThreadToFiber(nullptr);
+#endif
+	while (!stop_)
+	{
+		fiber* f = next(w);
+		if (f == nullptr)
+		{
+			if (!expire())
+				idle();
+			continue;
+		}
+		if (++w->runs % 64 == 0)
+			expire();
+		f->resume(w);
+		if (w->after == park)
+			f->parked();
+		else if (w->after == done)
+			finish(f);
+	}
+#if defined(_WIN32)
+	::ConvertFiberToThread();
+#endif
+	current_ = nullptr;
+}
+
+// fires the timers that are due, returning whether any did; busy
+// workers call it now and then too, so timers do not wait for one to
+// run out of work
+bool ipc::runtime::expire(void)
+{
+	std::vector<fiber*> expired;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::chrono::steady_clock::time_point now =
+			std::chrono::steady_clock::now();
+		while (!timers_.empty() && timers_.begin()->first <= now)
+		{
+			fiber* f = timers_.begin()->second;
+			f->timed_ = false;
+			timers_.erase(timers_.begin());
+			expired.push_back(f);
+		}
+	}
+	for (auto f: expired)
+		f->signal();
+	return !expired.empty();
+}
+
+// sleeps until a fiber is ready, the next timer is due or the runtime
+// is stopped
+void ipc::runtime::idle(void)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	idle_++;
+	if (pending_ == 0 && !stop_)
+	{
+		if (timers_.empty())
+			cond_.wait(lock);
+		else
+		{
+			std::chrono::steady_clock::time_point t = timers_.begin()->first;
+			cond_.wait_until(lock, t);
+		}
+	}
+	idle_--;
+}
+
+void ipc::runtime::add_timer(ipc::fiber* f,
+	const std::chrono::steady_clock::time_point& deadline)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	f->timer_ = timers_.insert(std::make_pair(deadline, f));
+	f->timed_ = true;
+	cond_.notify_one();
+}
+
+// false when the timer has already fired
+bool ipc::runtime::cancel_timer(ipc::fiber* f)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (!f->timed_)
+		return false;
+	timers_.erase(f->timer_);
+	f->timed_ = false;
+	return true;
+}
+
+void ipc::runtime::finish(ipc::fiber* f)
+{
+	f->clear();
+	{
+		std::lock_guard<std::mutex> lock(free_mutex_);
+		if (free_.size() < max_free)
+		{
+			free_.push_back(f);
+			f = nullptr;
+		}
+	}
+	delete f;
+	if (--live_ == 0)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		done_.notify_all();
+	}
+}
+
+void ipc::go(const std::function<void(void)>& fn)
+{
+	runtime::get()->go(fn);
+}
@@ -0,0 +1,91 @@
+#ifndef __IPC_RUNTIME__
+#define __IPC_RUNTIME__
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+
+#include "ipc.noncopyable.h"
+
+namespace ipc
+{
+	class fiber;
+
+	// runs lightweight fibers on a fixed pool of worker threads. every
+	// worker has its own run queue and steals half of another's when its
+	// own runs dry; a fiber that blocks on a channel, select or selector
+	// parks itself and frees the worker for the next one, and is queued
+	// again by whoever wakes it. a fiber may resume on any worker, so it
+	// must not keep thread local state across a blocking call. stacks are
+	// carved out of a few large mappings; with guard set each also gets a
+	// page below it that faults on overflow, which costs two mappings per
+	// fiber and so caps the fibers alive at once at about half of the
+	// system's vm.max_map_count
+	class runtime : public noncopyable
+	{
+		struct worker;
+		struct stack_pool;
+
+		static thread_local worker* current_;
+
+		std::vector<std::unique_ptr<worker>> workers_;
+		std::size_t stack_size_;
+
+		std::deque<fiber*> inject_;
+		std::mutex inject_mutex_;
+
+		std::atomic_size_t pending_;
+		std::atomic_size_t idle_;
+		std::atomic_bool stop_;
+
+		std::multimap<std::chrono::steady_clock::time_point, fiber*> timers_;
+		std::mutex mutex_;
+		std::condition_variable cond_;
+
+		std::atomic_size_t live_;
+		std::condition_variable done_;
+
+		std::vector<fiber*> free_;
+		std::mutex free_mutex_;
+
+		std::unique_ptr<stack_pool> stacks_;
+	public:
+		runtime(const std::size_t& threads = 0,
+			const std::size_t& stack_size = 64 * 1024,
+			const bool& guard = false);
+		virtual ~runtime(void);
+	public:
+		static runtime* get(void);
+	public:
+		std::size_t size(void) const;
+	public:
+		void go(const std::function<void(void)>& fn);
+		void wait(void);
+	private:
+		friend class fiber;
+	private:
+		void ready(fiber* f);
+		fiber* next(worker* w);
+		void run(worker* w);
+		bool expire(void);
+		void idle(void);
+	private:
+		void add_timer(fiber* f,
+			const std::chrono::steady_clock::time_point& deadline);
+		bool cancel_timer(fiber* f);
+	private:
+		void finish(fiber* f);
+	};
+
+	// starts fn on a fiber of the process wide runtime, which has one
+	// worker per hardware thread and is started on first use
+	void go(const std::function<void(void)>& fn);
+}
+
+#endif
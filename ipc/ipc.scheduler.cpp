@@ -1,5 +1,7 @@
 #include "ipc.scheduler.h"
 
+thread_local ipc::scheduler* ipc::scheduler::current_ = nullptr;
+
 ipc::scheduler::scheduler(void)
 	: nthreads_(0)
 	, stop_requested_(false)
@@ -15,6 +17,13 @@ void ipc::scheduler::run(void)
 {
 	std::unique_lock<std::mutex> lock(mutex_);
 
+	struct guard
+	{
+		scheduler* prev;
+		~guard(void) { current_ = prev; }
+	} g = { current_ };
+	current_ = this;
+
 	nthreads_++;
 	stop_requested_ = false;
 	stop_when_empty_ = false;
@@ -25,9 +34,11 @@ void ipc::scheduler::run(void)
 		{
 			while (!stop_requested_ && !stop_when_empty_ && tasks_.empty())
 				cond_.wait(lock);
-			std::chrono::system_clock::time_point t = tasks_.begin()->first;
+			// a task scheduled meanwhile may be due before the one waited for
+			std::chrono::system_clock::time_point t;
 			while (!stop_requested_ && !tasks_.empty() &&
-					cond_.wait_until(lock, t) != std::cv_status::timeout)
+					cond_.wait_until(lock, t = tasks_.begin()->first) !=
+						std::cv_status::timeout)
 				; // keep waiting until timeout
 			if (stop_requested_)
 				break;
@@ -60,6 +71,18 @@ void ipc::scheduler::stop(const bool& drain)
 	cond_.notify_all();
 }
 
+// the scheduler whose run the calling thread is in, or nullptr
+ipc::scheduler* ipc::scheduler::current(void)
+{
+	return current_;
+}
+
+// runs f as soon as a thread is free, after whatever is already due
+void ipc::scheduler::post(const ipc::func& f)
+{
+	schedule(f, std::chrono::system_clock::now());
+}
+
 void ipc::scheduler::schedule(const ipc::func& f,
 	const std::chrono::system_clock::time_point& t)
 {
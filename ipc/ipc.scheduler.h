@@ -5,6 +5,7 @@
 #include <cstdint>
 #include <chrono>
 #include <mutex>
+#include <condition_variable>
 #include <map>
 
 #include "ipc.noncopyable.h" 
@@ -15,6 +16,8 @@ namespace ipc
 
 	class scheduler : public noncopyable
 	{
+		static thread_local scheduler* current_;
+
 		std::multimap<std::chrono::system_clock::time_point, func> tasks_;
 		std::condition_variable cond_;
 		std::mutex mutex_;
@@ -29,6 +32,9 @@ namespace ipc
 	public:
 		void stop(const bool& drain = false);
 	public:
+		static scheduler* current(void);
+	public:
+		void post(const func& f);
 		void schedule(const func& f,
 			const std::chrono::system_clock::time_point& t);
 		void schedule(const func& f,
@@ -0,0 +1,140 @@
+#include "ipc.select.h"
+
+// channels are always locked in address order, so two selects that
+// share channels can never deadlock against each other
+std::size_t ipc::lockorder(const ipc::scase* cases, const std::size_t& n,
+	ipc::channable** order)
+{
+	std::size_t norder = 0;
+	for (std::size_t i = 0; i < n; i++)
+	{
+		channable* ch = cases[i].chan;
+		if (ch == nullptr)
+			continue;
+		std::size_t j = norder;
+		while (j > 0 && order[j - 1] > ch)
+			j--;
+		if (j > 0 && order[j - 1] == ch)
+			continue;
+		for (std::size_t k = norder; k > j; k--)
+			order[k] = order[k - 1];
+		order[j] = ch;
+		norder++;
+	}
+	return norder;
+}
+
+void ipc::sellock(ipc::channable* const* order, const std::size_t& n)
+{
+	for (std::size_t i = 0; i < n; i++)
+		order[i]->lock();
+}
+
+// a channel is settled only once every lock is released, see
+// basic_channel::settle
+void ipc::selunlock(ipc::channable* const* order, const std::size_t& n)
+{
+	for (std::size_t i = n; i > 0; i--)
+		order[i - 1]->unlock();
+	for (std::size_t i = 0; i < n; i++)
+		order[i]->settle();
+}
+
+// starts from a random case so no case starves the others
+int ipc::selpoll(ipc::context* ctext, const ipc::scase* cases,
+	const std::size_t& n)
+{
+	std::size_t i = n < 1 ? 0 : ctext->random() % n;
+	for (std::size_t k = 0; k < n; k++)
+	{
+		channable* ch = cases[i].chan;
+		if (ch != nullptr)
+		{
+			bool ready = cases[i].recv ?
+				ch->peek(cases[i].data) : ch->poke(cases[i].data);
+			if (ready)
+				return static_cast<int>(i);
+		}
+		if (++i >= n)
+			i = 0;
+	}
+	return -1;
+}
+
+// all channels stay locked across the poll and the enqueue, so a case
+// can not become ready in between; once woken the node that fired has
+// already been unlinked and the rest are unlinked one channel at a
+// time, only a retry takes every lock again before polling once more.
+// a case that throws while polled, a send on a closed channel, leaves
+// every channel unlocked
+int ipc::select_cases(const ipc::scase* cases, const std::size_t& n,
+	ipc::channable* const* order, const std::size_t& norder,
+	const bool& block, const std::chrono::steady_clock::time_point* deadline)
+{
+	context* ctext = context::get();
+	for (std::size_t i = 0; i < n; i++)
+		ctext->add(cases[i].chan, cases[i].data, cases[i].recv);
+
+	sellock(order, norder);
+	while (true)
+	{
+		int i;
+		try
+		{
+			i = selpoll(ctext, cases, n);
+		}
+		catch (...)
+		{
+			selunlock(order, norder);
+			ctext->clear();
+			throw;
+		}
+		if (i != -1)
+		{
+			selunlock(order, norder);
+			ctext->clear();
+			return i;
+		}
+
+		if (!block)
+		{
+			selunlock(order, norder);
+			ctext->clear();
+			return -1;
+		}
+
+		ctext->add_to_all_channels();
+		selunlock(order, norder);
+		bool woken = true;
+		try
+		{
+			if (deadline == nullptr)
+				ctext->wait();
+			else
+				woken = ctext->wait_until(*deadline);
+		}
+		catch (...)
+		{
+			ctext->remove_from_all_channels(true);
+			ctext->clear();
+			return -1;
+		}
+		if (!woken)
+		{
+			ctext->remove_from_all_channels(true);
+			ctext->clear();
+			return -1;
+		}
+		int index = ctext->get_unblocked_index();
+		if (index == -1)
+		{
+			sellock(order, norder);
+			ctext->remove_from_all_channels();
+			ctext->rearm();
+			continue;
+		}
+		ctext->remove_from_all_channels(true);
+		ctext->clear();
+		return index;
+	}
+}
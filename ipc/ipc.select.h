@@ -0,0 +1,280 @@
+#ifndef __IPC_SELECT__
+#define __IPC_SELECT__
+
+#include "ipc.channel.h"
+
+#include <initializer_list>
+#include <chrono>
+#include <type_traits>
+#include <utility>
+
+namespace ipc
+{
+	// one case as the select engine sees it: a receive constructs the
+	// value into data, a send moves from it; a null chan is never ready
+	struct scase
+	{
+		channable* chan;
+		void* data;
+		bool recv;
+	};
+
+	// fills order with the distinct channels of the cases sorted by
+	// address, returning how many there are; order needs room for n
+	std::size_t lockorder(const scase* cases, const std::size_t& n,
+		channable** order);
+
+	// lock and unlock the channels lockorder sorted, the latter in
+	// reverse order
+	void sellock(channable* const* order, const std::size_t& n);
+	void selunlock(channable* const* order, const std::size_t& n);
+
+	// with every channel locked, tries each case once; returns the index
+	// of the case that went ahead, or -1 when none was ready
+	int selpoll(context* ctext, const scase* cases, const std::size_t& n);
+
+	// the engine behind selector and select; returns the index of the
+	// case that went ahead, or -1 when block is false and none was ready
+	// or when the deadline, if any, passed first
+	int select_cases(const scase* cases, const std::size_t& n,
+		channable* const* order, const std::size_t& norder,
+		const bool& block,
+		const std::chrono::steady_clock::time_point* deadline = nullptr);
+
+	// the element type of anything select can wait on; substitution fails
+	// for what is not a channel, so overloads taking one step aside
+	template <class Chan>
+	using channel_value = typename std::enable_if<
+		std::is_base_of<channable, Chan>::value,
+		typename Chan::value_type>::type;
+
+	template <class F, class... Args>
+	struct is_callable
+	{
+		template <class G>
+		static auto test(int) -> decltype(
+			std::declval<G&>()(std::declval<Args>()...), std::true_type());
+		template <class G>
+		static std::false_type test(...);
+		static constexpr bool value = decltype(test<F>(0))::value;
+	};
+
+	// the value is received straight into storage inside the case and
+	// moved from there into the handler
+	template <class Chan, class F>
+	class recv_case
+	{
+		typedef channel_value<Chan> T;
+		static_assert(is_callable<F, T&&>::value,
+			"case_recv handler must be callable with the channel's value");
+
+		Chan* chan_;
+		F fn_;
+		slot<T> storage_;
+	public:
+		static constexpr bool is_default = false;
+	public:
+		recv_case(Chan& chan, F&& fn);
+	public:
+		scase get(void);
+		void fire(void);
+	};
+
+	template <class Chan, class F>
+	recv_case<Chan, F>::recv_case(Chan& chan, F&& fn)
+		: chan_(&chan)
+		, fn_(std::move(fn))
+	{
+	}
+
+	template <class Chan, class F>
+	scase recv_case<Chan, F>::get(void)
+	{
+		scase c = { chan_, &storage_, true };
+		return c;
+	}
+
+	template <class Chan, class F>
+	void recv_case<Chan, F>::fire(void)
+	{
+		struct guard
+		{
+			T* p;
+			~guard(void) { p->~T(); }
+		} g = { reinterpret_cast<T*>(&storage_) };
+		fn_(std::move(*g.p));
+	}
+
+	template <class Chan, class F>
+	class send_case
+	{
+		typedef channel_value<Chan> T;
+		static_assert(is_callable<F>::value,
+			"case_send handler must be callable without arguments");
+
+		Chan* chan_;
+		T data_;
+		F fn_;
+	public:
+		static constexpr bool is_default = false;
+	public:
+		template <class U>
+		send_case(Chan& chan, U&& data, F&& fn);
+	public:
+		scase get(void);
+		void fire(void);
+	};
+
+	template <class Chan, class F>
+	template <class U>
+	send_case<Chan, F>::send_case(Chan& chan, U&& data, F&& fn)
+		: chan_(&chan)
+		, data_(std::forward<U>(data))
+		, fn_(std::move(fn))
+	{
+	}
+
+	template <class Chan, class F>
+	scase send_case<Chan, F>::get(void)
+	{
+		scase c = { chan_, &data_, false };
+		return c;
+	}
+
+	template <class Chan, class F>
+	void send_case<Chan, F>::fire(void)
+	{
+		fn_();
+	}
+
+	template <class F>
+	class default_case
+	{
+		static_assert(is_callable<F>::value,
+			"case_default handler must be callable without arguments");
+
+		F fn_;
+	public:
+		static constexpr bool is_default = true;
+	public:
+		default_case(F&& fn);
+	public:
+		scase get(void);
+		void fire(void);
+	};
+
+	template <class F>
+	default_case<F>::default_case(F&& fn)
+		: fn_(std::move(fn))
+	{
+	}
+
+	template <class F>
+	scase default_case<F>::get(void)
+	{
+		scase c = { nullptr, nullptr, false };
+		return c;
+	}
+
+	template <class F>
+	void default_case<F>::fire(void)
+	{
+		fn_();
+	}
+
+	template <class Chan, class F>
+	recv_case<Chan, typename std::decay<F>::type> case_recv(Chan& chan, F&& fn)
+	{
+		return recv_case<Chan, typename std::decay<F>::type>(
+			chan, typename std::decay<F>::type(std::forward<F>(fn)));
+	}
+
+	template <class Chan, class U, class F>
+	send_case<Chan, typename std::decay<F>::type> case_send(Chan& chan,
+		U&& data, F&& fn)
+	{
+		return send_case<Chan, typename std::decay<F>::type>(
+			chan, std::forward<U>(data),
+			typename std::decay<F>::type(std::forward<F>(fn)));
+	}
+
+	template <class F>
+	default_case<typename std::decay<F>::type> case_default(F&& fn)
+	{
+		return default_case<typename std::decay<F>::type>(
+			typename std::decay<F>::type(std::forward<F>(fn)));
+	}
+
+	template <class... Cases>
+	struct count_defaults;
+
+	template <>
+	struct count_defaults<>
+	{
+		static constexpr int value = 0;
+	};
+
+	template <class Case, class... Cases>
+	struct count_defaults<Case, Cases...>
+	{
+		static constexpr int value = (std::decay<Case>::type::is_default ? 1 : 0) +
+			count_defaults<Cases...>::value;
+	};
+
+	template <class... Cases>
+	int basic_select(const std::chrono::steady_clock::time_point* deadline,
+		Cases&&... cases)
+	{
+		static_assert(sizeof...(Cases) > 0, "select needs at least one case");
+		static_assert(count_defaults<Cases...>::value <= 1,
+			"select takes at most one default case");
+		const std::size_t n = sizeof...(Cases);
+		const bool block = count_defaults<Cases...>::value == 0;
+
+		scase sc[n] = { cases.get()... };
+		channable* order[n];
+		std::size_t norder = lockorder(sc, n, order);
+
+		int index = select_cases(sc, n, order, norder, block, deadline);
+		if (index == -1)
+		{
+			int i = 0;
+			(void)std::initializer_list<int>{ (std::decay<Cases>::type::is_default ?
+				(index = i, cases.fire(), i++) : i++)... };
+			return index;
+		}
+		int i = 0;
+		(void)std::initializer_list<int>{ (i == index ?
+			(cases.fire(), i++) : i++)... };
+		return index;
+	}
+
+	// go's select: waits until one of the cases can go ahead, or runs the
+	// default case when there is one and nothing is ready, then calls that
+	// case's handler and returns its index; every case lives on the
+	// caller's stack, so nothing is allocated and nothing is type erased
+	template <class... Cases>
+	int select(Cases&&... cases)
+	{
+		return basic_select(nullptr, std::forward<Cases>(cases)...);
+	}
+
+	// as select, returning -1 without running a handler once the deadline
+	// has passed
+	template <class... Cases>
+	int select_until(const std::chrono::steady_clock::time_point& deadline,
+		Cases&&... cases)
+	{
+		return basic_select(&deadline, std::forward<Cases>(cases)...);
+	}
+
+	template <class... Cases>
+	int select_for(const std::chrono::steady_clock::duration& timeout,
+		Cases&&... cases)
+	{
+		return select_until(std::chrono::steady_clock::now() + timeout,
+			std::forward<Cases>(cases)...);
+	}
+}
+
+#endif
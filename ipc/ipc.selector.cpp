@@ -1,101 +1,95 @@
 #include "ipc.selector.h"
 
+#include <algorithm>
+
 ipc::selector::selector(void)
 	: data_(nullptr)
+	, data_destroy_(nullptr)
 {
 }
 
 ipc::selector::~selector(void)
 {
-	set_data(nullptr);
+	clear();
 }
 
+// clearing the cases also drops a received value not yet taken
 void ipc::selector::clear(void)
 {
-	send_data_.clear();
+	set_data(nullptr, nullptr);
+	for (std::size_t i = 0; i < cases_.size(); i++)
+	{
+		if (!cases_[i].recv && cases_[i].chan != nullptr)
+			info_[i].destroy(cases_[i].data);
+		info_[i].release(cases_[i].data);
+	}
+	cases_.clear();
+	info_.clear();
+	order_.clear();
+}
+
+// channels are always locked in address order, so two selectors that
+// share channels can never deadlock against each other; the order is
+// kept sorted as cases are added rather than rebuilt on every select
+int ipc::selector::add(ipc::channable* chan, void* data, const bool& recv,
+	const void* type, void (*destroy)(void*), void (*release)(void*))
+{
+	scase c = { chan, data, recv };
+	selcase info = { chan, type, destroy, release };
+	cases_.push_back(c);
+	info_.push_back(info);
+	auto it = std::lower_bound(order_.begin(), order_.end(), chan);
+	if (it == order_.end() || *it != chan)
+		order_.insert(it, chan);
+	return static_cast<int>(cases_.size() - 1);
 }
 
 int ipc::selector::select(const bool& block)
 {
-	std::shared_ptr<context> ctext = context::get();
-	for (auto sd: send_data_)
-		ctext->add(sd.first, sd.second);
+	return select(block, nullptr);
+}
 
-	while (true)
-	{
-		std::size_t size = ctext->send_data_size();
-		std::size_t i = size < 1 ? 0 : std::rand() % size;
-		for (std::size_t n = 0; n < size; n++)
-		{
-			channable* ch = ctext->send_data_channel(i);
-			if (ch != nullptr)
-			{
-				void* data = ctext->send_data_data(i);
-				if (data == nullptr)
-				{
-					void* peek = ch->peek();
-					if (peek != nullptr)
-					{
-						ctext->clear();
-						set_data(peek);
-						return i;
-					}
-				}
-				else
-				{
-					bool dont_block = ch->poke(data);
-					if (dont_block)
-					{
-						ctext->clear();
-						set_data(nullptr);
-						return i;
-					}
-				}
-			}
-			if (++i >= size)
-				i = 0;
-		}
+// -1 once the deadline has passed without any case going ahead
+int ipc::selector::select_until(
+	const std::chrono::steady_clock::time_point& deadline)
+{
+	return select(true, &deadline);
+}
 
-		if (!block)
-			return -1;
+int ipc::selector::select_for(
+	const std::chrono::steady_clock::duration& timeout)
+{
+	return select_until(std::chrono::steady_clock::now() + timeout);
+}
 
-		std::lock_guard<std::mutex> lock(context::mutex);
-		ctext->add_to_all_channels();
-		try
-		{
-			ctext->wait();
-		}
-		catch (...)
-		{
-			ctext->remove_from_all_channels();
-			ctext->clear();
-			return -1;
-		}
-		if (ctext->get_unblocked_index() == -1)
-		{
-			ctext->remove_from_all_channels();
-			continue;
-		}
-		if (ctext->send_data_size() > 0)
-		{
-			ctext->clear();
-			throw std::runtime_error("channel exist");
-		}
-		int index = ctext->get_unblocked_index();
-		if (index == -1)
-		{
-			ctext->clear();
-			throw std::runtime_error("illegal state");
-		}
-		set_data(ctext->get_receive_data());
-		ctext->clear();
-		return index;
-	}
+int ipc::selector::select(const bool& block,
+	const std::chrono::steady_clock::time_point* deadline)
+{
+	set_data(nullptr, nullptr);
+	int index = select_cases(cases_.data(), cases_.size(),
+		order_.data(), order_.size(), block, deadline);
+	if (index == -1)
+		return -1;
+	if (cases_[index].recv)
+		set_data(cases_[index].data, info_[index].destroy);
+	else
+		spend(index);
+	return index;
 }
 
-void ipc::selector::set_data(void* data)
+// a send case that went out holds a moved from value, it is destroyed
+// here and the slot left raw until update constructs the next one; the
+// case loses its channel meanwhile, so the engine never finds it ready
+void ipc::selector::spend(const int& index)
+{
+	info_[index].destroy(cases_[index].data);
+	cases_[index].chan = nullptr;
+}
+
+void ipc::selector::set_data(void* data, void (*destroy)(void*))
 {
 	if (data_ != nullptr)
-		delete data_;
+		data_destroy_(data_);
 	data_ = data;
-}
\ No newline at end of file
+	data_destroy_ = destroy;
+}
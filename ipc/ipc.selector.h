@@ -2,68 +2,157 @@
 #define __IPC_SELECTOR__
 
 #include "ipc.channel.h"
+#include "ipc.select.h"
+#include "ipc.pool.h"
 #include "ipc.noncopyable.h"
 
 #include <memory>
+#include <type_traits>
 
 namespace ipc
 {
+	// a selector is built once and may be selected on any number of
+	// times; the cases stay put between calls, a send case is spent once
+	// its value went out and sits out every select until update gives it
+	// a new one
 	class selector : public noncopyable
 	{
+		struct selcase
+		{
+			channable* chan;
+			const void* type;
+			void (*destroy)(void*);
+			void (*release)(void*);
+		};
+
 		void* data_;
-		std::vector<std::pair<channable*, void*>> send_data_;
+		void (*data_destroy_)(void*);
+		std::vector<scase> cases_;
+		std::vector<selcase> info_;
+		std::vector<channable*> order_;
 	public:
 		selector(void);
 		virtual ~selector(void);
 	public:
-		template <class T>
-		void send(channel<T>& chan, const T& data);
-		template <class T>
-		void send(const std::shared_ptr<channel<T>>& chan, const T& data);
+		template <class Chan>
+		int send(Chan& chan, const channel_value<Chan>& data);
+		template <class Chan>
+		int send(Chan& chan, channel_value<Chan>&& data);
+		template <class Chan, class T>
+		int send(const std::shared_ptr<Chan>& chan, T&& data);
+	public:
+		template <class Chan, class T = channel_value<Chan>>
+		int recv(Chan& chan);
+		template <class Chan>
+		int recv(const std::shared_ptr<Chan>& chan);
 	public:
 		template <class T>
-		void recv(channel<T>& chan);
-		template <class T>
-		void recv(const std::shared_ptr<channel<T>>& chan);
+		void update(const int& index, T&& data);
 	public:
 		template <class T>
-		T get_data(void) const;
+		T get_data(void);
 	public:
 		void clear(void);
 	public:
 		int select(const bool& block = true);
+		int select_until(const std::chrono::steady_clock::time_point& deadline);
+		int select_for(const std::chrono::steady_clock::duration& timeout);
+	private:
+		int select(const bool& block,
+			const std::chrono::steady_clock::time_point* deadline);
+		void set_data(void* data, void (*destroy)(void*));
+		void spend(const int& index);
+		int add(channable* chan, void* data, const bool& recv,
+			const void* type, void (*destroy)(void*), void (*release)(void*));
 	private:
-		void set_data(void* data);
+		template <class T>
+		static const void* type(void);
+		template <class T>
+		static void destroy(void* data);
 	};
 
-	template <class T>
-	void selector::send(channel<T>& chan, const T& data)
+	// every case owns a pooled slot for as long as it lives: a send case
+	// holds the value to send, a receive case is raw storage the received
+	// value is moved into; both return the index select reports
+	template <class Chan>
+	int selector::send(Chan& chan, const channel_value<Chan>& data)
+	{
+		typedef channel_value<Chan> T;
+		void* p = pool<T>::allocate();
+		new (p) T(data);
+		return add(&chan, p, false, type<T>(),
+			&selector::destroy<T>, &pool<T>::deallocate);
+	}
+
+	template <class Chan>
+	int selector::send(Chan& chan, channel_value<Chan>&& data)
+	{
+		typedef channel_value<Chan> T;
+		void* p = pool<T>::allocate();
+		new (p) T(std::move(data));
+		return add(&chan, p, false, type<T>(),
+			&selector::destroy<T>, &pool<T>::deallocate);
+	}
+
+	template <class Chan, class T>
+	int selector::send(const std::shared_ptr<Chan>& chan, T&& data)
+	{
+		return send(*chan, std::forward<T>(data));
+	}
+
+	template <class Chan, class T>
+	int selector::recv(Chan& chan)
+	{
+		return add(&chan, pool<T>::allocate(), true, type<T>(),
+			&selector::destroy<T>, &pool<T>::deallocate);
+	}
+
+	template <class Chan>
+	int selector::recv(const std::shared_ptr<Chan>& chan)
 	{
-		send_data_.push_back(std::make_pair(&chan, new T(data)));
+		return recv(*chan);
 	}
 
+	// replaces the value a send case offers, assigning over it while it
+	// is still waiting to go out and constructing it in place otherwise.
+	// the case's slot is only known at run time, so the value must already
+	// be of the channel's element type; a value that merely converts to it
+	// names the type, as in update<std::string>(index, "text")
 	template <class T>
-	void selector::send(const std::shared_ptr<channel<T>>& chan, const T& data)
+	void selector::update(const int& index, T&& data)
 	{
-		send_data_.push_back(std::make_pair(chan.get(), new T(data)));
+		typedef typename std::decay<T>::type value_type;
+		scase& c = cases_.at(index);
+		if (c.recv)
+			throw std::invalid_argument("update on a receive case");
+		if (info_[index].type != type<value_type>())
+			throw std::invalid_argument("update with a value of another type");
+		if (c.chan != nullptr)
+			*static_cast<value_type*>(c.data) = std::forward<T>(data);
+		else
+			new (c.data) value_type(std::forward<T>(data));
+		c.chan = info_[index].chan;
 	}
 
+	// moves the received value out, so it can be taken only once
 	template <class T>
-	void selector::recv(channel<T>& chan)
+	T selector::get_data(void)
 	{
-		send_data_.push_back(std::make_pair(&chan, nullptr));
+		return std::move(*static_cast<T*>(data_));
 	}
 
+	// an address unique to T, for update to tell a case's type by
 	template <class T>
-	void selector::recv(const std::shared_ptr<channel<T>>& chan)
+	const void* selector::type(void)
 	{
-		send_data_.push_back(std::make_pair(chan.get(), nullptr));
+		static const char tag = 0;
+		return &tag;
 	}
 
 	template <class T>
-	T selector::get_data(void) const
+	void selector::destroy(void* data)
 	{
-		return *static_cast<T*>(data_);
+		static_cast<T*>(data)->~T();
 	}
 };
 
@@ -0,0 +1,141 @@
+#include "ipc.semaphore.h"
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <ctime>
+#include <cerrno>
+#include <climits>
+#endif
+
+ipc::semaphore::semaphore(void)
+	: count_(0)
+{
+}
+
+#if defined(__linux__)
+
+static_assert(sizeof(std::atomic_int) == sizeof(int),
+	"the count must be usable as a futex word");
+
+// the futex word holds the count above its lowest bit, which is set
+// while a thread may be asleep on it
+static const int sleeping = 1;
+static const int one = 2;
+
+static int futex(std::atomic_int* addr, int op, int val,
+	const struct timespec* timeout = nullptr)
+{
+	return static_cast<int>(syscall(SYS_futex, reinterpret_cast<int*>(addr),
+		op | FUTEX_PRIVATE_FLAG, val, timeout, nullptr, FUTEX_BITSET_MATCH_ANY));
+}
+
+// a thread takes one from the count only while it is above zero
+bool ipc::semaphore::try_wait(void)
+{
+	int count = count_.load(std::memory_order_seq_cst);
+	while (count >= one)
+		if (count_.compare_exchange_weak(count, count - one,
+				std::memory_order_seq_cst))
+			return true;
+	return false;
+}
+
+// raising the count and clearing the flag is the one access to the
+// semaphore; the wake after it only names the address, a private futex
+// being looked up by address without reading it, so it is harmless when
+// the waiter has already gone. every sleeper is woken, since the flag is
+// cleared for all of them, and those that find nothing set it again
+void ipc::semaphore::post(void)
+{
+	int count = count_.load(std::memory_order_relaxed);
+	while (!count_.compare_exchange_weak(count, (count + one) & ~sleeping,
+			std::memory_order_seq_cst))
+		;
+	if (count & sleeping)
+		futex(&count_, FUTEX_WAKE, INT_MAX);
+}
+
+// sets the flag on an empty count, so that the next post wakes us; false
+// when the count was raised meanwhile
+static bool prepare(std::atomic_int& word)
+{
+	int count = word.load(std::memory_order_seq_cst);
+	if (count >= one)
+		return false;
+	return count == sleeping || word.compare_exchange_strong(count,
+		sleeping, std::memory_order_seq_cst);
+}
+
+void ipc::semaphore::wait(void)
+{
+	while (!try_wait())
+		if (prepare(count_))
+			futex(&count_, FUTEX_WAIT_BITSET, sleeping);
+}
+
+// steady_clock is CLOCK_MONOTONIC here, the same clock an absolute
+// FUTEX_WAIT_BITSET timeout is measured against; a flag left set by a
+// timed out waiter only costs the next post a wake
+bool ipc::semaphore::wait_until(
+	const std::chrono::steady_clock::time_point& deadline)
+{
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		deadline.time_since_epoch()).count();
+	struct timespec ts;
+	ts.tv_sec = static_cast<time_t>(ns / 1000000000);
+	ts.tv_nsec = static_cast<long>(ns % 1000000000);
+	while (!try_wait())
+	{
+		if (!prepare(count_))
+			continue;
+		int rc = futex(&count_, FUTEX_WAIT_BITSET, sleeping, &ts);
+		if (rc == -1 && errno == ETIMEDOUT)
+			return try_wait();
+	}
+	return true;
+}
+
+#else
+
+// the count is only touched under the mutex, so a waiter cannot see a
+// post, return and let its semaphore go while the poster still holds it
+bool ipc::semaphore::try_wait(void)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	int count = count_.load(std::memory_order_relaxed);
+	if (count == 0)
+		return false;
+	count_.store(count - 1, std::memory_order_relaxed);
+	return true;
+}
+
+void ipc::semaphore::post(void)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	count_.fetch_add(1, std::memory_order_relaxed);
+	cond_.notify_one();
+}
+
+void ipc::semaphore::wait(void)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (count_.load(std::memory_order_relaxed) == 0)
+		cond_.wait(lock);
+	count_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+bool ipc::semaphore::wait_until(
+	const std::chrono::steady_clock::time_point& deadline)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (count_.load(std::memory_order_relaxed) == 0)
+		if (cond_.wait_until(lock, deadline) == std::cv_status::timeout &&
+				count_.load(std::memory_order_relaxed) == 0)
+			return false;
+	count_.fetch_sub(1, std::memory_order_relaxed);
+	return true;
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef __IPC_SEMAPHORE__
+#define __IPC_SEMAPHORE__
+
+#include <atomic>
+#include <chrono>
+
+#if !defined(__linux__)
+#include <mutex>
+#include <condition_variable>
+#endif
+
+#include "ipc.noncopyable.h"
+
+namespace ipc
+{
+	// counting semaphore a thread parks on. a waiter may return, and its
+	// thread exit with the semaphore, as soon as it sees the post, so the
+	// post never reads the semaphore after publishing it. on linux the
+	// count and a sleeper flag share the futex word: posting is one
+	// atomic update and, only when somebody is asleep, one wake, which
+	// needs the word's address but not its memory; elsewhere it falls
+	// back to a mutex and condition variable, posted under the mutex
+	class semaphore : public noncopyable
+	{
+		std::atomic_int count_;
+#if !defined(__linux__)
+		std::mutex mutex_;
+		std::condition_variable cond_;
+#endif
+	public:
+		semaphore(void);
+	public:
+		void post(void);
+	public:
+		bool try_wait(void);
+		void wait(void);
+		bool wait_until(const std::chrono::steady_clock::time_point& deadline);
+	};
+}
+
+#endif
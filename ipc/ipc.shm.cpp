@@ -0,0 +1,167 @@
+#include "ipc.shm.h"
+
+#include <stdexcept>
+#include <thread>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <ctime>
+#endif
+
+#if defined(__linux__)
+
+// O_EXCL decides which process creates the segment; everybody else
+// waits for the creator to give it its size before mapping it
+ipc::shm_segment::shm_segment(const std::string& name, const std::size_t& size)
+	: name_(name)
+	, fd_(-1)
+	, addr_(nullptr)
+	, size_(size)
+	, created_(false)
+{
+	fd_ = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd_ != -1)
+	{
+		created_ = true;
+		if (::ftruncate(fd_, static_cast<off_t>(size)) == -1)
+		{
+			::close(fd_);
+			::shm_unlink(name.c_str());
+			throw std::runtime_error("shm segment could not be sized");
+		}
+	}
+	else
+	{
+		if (errno != EEXIST)
+			throw std::runtime_error("shm_open failed");
+		fd_ = ::shm_open(name.c_str(), O_RDWR, 0600);
+		if (fd_ == -1)
+			throw std::runtime_error("shm_open failed");
+		struct stat st;
+		while (::fstat(fd_, &st) == 0 && st.st_size == 0)
+			std::this_thread::yield();
+		if (static_cast<std::size_t>(st.st_size) != size)
+		{
+			::close(fd_);
+			throw std::runtime_error("shm segment has a different size");
+		}
+	}
+	addr_ = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+	if (addr_ == MAP_FAILED)
+	{
+		::close(fd_);
+		throw std::runtime_error("mmap failed");
+	}
+}
+
+ipc::shm_segment::~shm_segment(void)
+{
+	::munmap(addr_, size_);
+	::close(fd_);
+}
+
+void ipc::shm_segment::unlink(const std::string& name)
+{
+	::shm_unlink(name.c_str());
+}
+
+static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t),
+	"futex words must be plain 32 bit words");
+
+static long futex(std::atomic<std::uint32_t>& word, int op, std::uint32_t val,
+	const struct timespec* timeout = nullptr)
+{
+	return syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word),
+		op, val, timeout, nullptr, FUTEX_BITSET_MATCH_ANY);
+}
+
+void ipc::futex_wait(std::atomic<std::uint32_t>& word, const std::uint32_t& val)
+{
+	futex(word, FUTEX_WAIT_BITSET, val);
+}
+
+// false once the deadline has passed, steady_clock being CLOCK_MONOTONIC
+bool ipc::futex_wait_until(std::atomic<std::uint32_t>& word,
+	const std::uint32_t& val,
+	const std::chrono::steady_clock::time_point& deadline)
+{
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		deadline.time_since_epoch()).count();
+	struct timespec ts;
+	ts.tv_sec = static_cast<time_t>(ns / 1000000000);
+	ts.tv_nsec = static_cast<long>(ns % 1000000000);
+	return !(futex(word, FUTEX_WAIT_BITSET, val, &ts) == -1 && errno == ETIMEDOUT);
+}
+
+void ipc::futex_wake(std::atomic<std::uint32_t>& word, const int& count)
+{
+	futex(word, FUTEX_WAKE, static_cast<std::uint32_t>(count));
+}
+
+#else
+
+ipc::shm_segment::shm_segment(const std::string& name, const std::size_t& size)
+	: name_(name)
+	, fd_(-1)
+	, addr_(nullptr)
+	, size_(size)
+	, created_(false)
+{
+	throw std::runtime_error("shared memory channels need linux");
+}
+
+ipc::shm_segment::~shm_segment(void)
+{
+}
+
+void ipc::shm_segment::unlink(const std::string& name)
+{
+}
+
+// without futexes a sleeper polls the word, which stays correct since
+// every waker changes it before waking
+void ipc::futex_wait(std::atomic<std::uint32_t>& word, const std::uint32_t& val)
+{
+	while (word.load() == val)
+		std::this_thread::sleep_for(std::chrono::microseconds(50));
+}
+
+bool ipc::futex_wait_until(std::atomic<std::uint32_t>& word,
+	const std::uint32_t& val,
+	const std::chrono::steady_clock::time_point& deadline)
+{
+	while (word.load() == val)
+	{
+		if (std::chrono::steady_clock::now() >= deadline)
+			return false;
+		std::this_thread::sleep_for(std::chrono::microseconds(50));
+	}
+	return true;
+}
+
+void ipc::futex_wake(std::atomic<std::uint32_t>& word, const int& count)
+{
+}
+
+#endif
+
+void* ipc::shm_segment::address(void) const
+{
+	return addr_;
+}
+
+std::size_t ipc::shm_segment::size(void) const
+{
+	return size_;
+}
+
+bool ipc::shm_segment::created(void) const
+{
+	return created_;
+}
@@ -0,0 +1,44 @@
+#ifndef __IPC_SHM__
+#define __IPC_SHM__
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+
+#include "ipc.noncopyable.h"
+
+namespace ipc
+{
+	// a named posix shared memory segment mapped into this process; the
+	// process that creates the name sees created() and sets the contents
+	// up, every other one maps what is there once it has its full size
+	class shm_segment : public noncopyable
+	{
+		std::string name_;
+		int fd_;
+		void* addr_;
+		std::size_t size_;
+		bool created_;
+	public:
+		shm_segment(const std::string& name, const std::size_t& size);
+		~shm_segment(void);
+	public:
+		void* address(void) const;
+		std::size_t size(void) const;
+		bool created(void) const;
+	public:
+		static void unlink(const std::string& name);
+	};
+
+	// futex calls on words that may live in shared memory, so sleepers in
+	// other processes are found too
+	void futex_wait(std::atomic<std::uint32_t>& word, const std::uint32_t& val);
+	bool futex_wait_until(std::atomic<std::uint32_t>& word,
+		const std::uint32_t& val,
+		const std::chrono::steady_clock::time_point& deadline);
+	void futex_wake(std::atomic<std::uint32_t>& word, const int& count);
+}
+
+#endif
@@ -0,0 +1,515 @@
+#ifndef __IPC_SHM_CHANNEL__
+#define __IPC_SHM_CHANNEL__
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <string>
+#include <climits>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+#include "ipc.channel.h"
+#include "ipc.shm.h"
+#include "ipc.noncopyable.h"
+
+namespace ipc
+{
+	// the cells of a shm_channel's ring, after its header in the segment,
+	// and the positions, which live in the header; only the process that
+	// created the segment sets them up
+	template <class T>
+	struct shm_cells
+	{
+		typedef std::uint64_t pos_type;
+		typedef ring_cell<T, pos_type> cell;
+
+		cell* buffer;
+		std::size_t capacity;
+		std::size_t mask;
+
+		std::atomic<pos_type>& enqueue_pos;
+		std::atomic<pos_type>& dequeue_pos;
+	public:
+		shm_cells(void* buffer, const std::size_t& capacity,
+			std::atomic<pos_type>& enqueue_pos,
+			std::atomic<pos_type>& dequeue_pos, const bool& create);
+	};
+
+	template <class T>
+	shm_cells<T>::shm_cells(void* buffer, const std::size_t& capacity,
+		std::atomic<pos_type>& enqueue_pos, std::atomic<pos_type>& dequeue_pos,
+		const bool& create)
+		: buffer(static_cast<cell*>(buffer))
+		, capacity(capacity)
+		, mask(capacity - 1)
+		, enqueue_pos(enqueue_pos)
+		, dequeue_pos(dequeue_pos)
+	{
+		if (!create)
+			return;
+		enqueue_pos.store(0, std::memory_order_relaxed);
+		dequeue_pos.store(0, std::memory_order_relaxed);
+		for (std::size_t i = 0; i < capacity; i++)
+		{
+			new (&this->buffer[i]) cell;
+			this->buffer[i].seq.store(2 * i, std::memory_order_relaxed);
+		}
+	}
+
+	// a buffered channel between processes: the ring, its indices and the
+	// futex word everybody sleeps on live in a named shared memory segment,
+	// so a send or recv that does not have to wait is a couple of atomics
+	// and no syscall. a process that selects on it parks its contexts on
+	// a local queue, which a watcher thread started on first use serves
+	// whenever the segment changes
+	template <class T>
+	class shm_channel : public channable, public noncopyable
+	{
+		static_assert(std::is_trivially_copyable<T>::value,
+			"shm_channel needs a trivially copyable type");
+		static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+			"shm_channel needs address free atomics");
+
+		static constexpr std::uint32_t ready = 0x69706331;
+
+		// state is bumped by every push, pop and close, and is the futex
+		// word of every sleeper; sleepers counts them so that nobody
+		// makes the wake syscall while no one is asleep
+		struct header
+		{
+			std::atomic<std::uint32_t> magic;
+			std::uint32_t element_size;
+			std::uint64_t capacity;
+			alignas(cache_line_size) std::atomic<std::uint64_t> enqueue_pos;
+			alignas(cache_line_size) std::atomic<std::uint64_t> dequeue_pos;
+			alignas(cache_line_size) std::atomic<std::uint32_t> state;
+			std::atomic<std::uint32_t> sleepers;
+			std::atomic<std::uint32_t> closed;
+		};
+
+		shm_segment segment_;
+		header* header_;
+		basic_mpmc_ring<T, shm_cells<T>> ring_;
+
+		waitq recvq_;
+		waitq sendq_;
+		std::mutex mutex_;
+		std::condition_variable cond_;
+		std::thread watcher_;
+		bool stop_;
+	public:
+		typedef T value_type;
+	public:
+		shm_channel(const std::string& name, int size = 1);
+		virtual ~shm_channel(void);
+	public:
+		std::size_t capacity(void) const;
+		std::size_t size(void) const;
+		bool empty(void) const;
+	public:
+		bool send(const T& data, const bool& block = true);
+		bool send_until(const T& data,
+			const std::chrono::steady_clock::time_point& deadline);
+		bool send_for(const T& data,
+			const std::chrono::steady_clock::duration& timeout);
+	public:
+		result<T> recv(const bool& block = true);
+		result<T> recv_until(
+			const std::chrono::steady_clock::time_point& deadline);
+		result<T> recv_for(const std::chrono::steady_clock::duration& timeout);
+	public:
+		void close(void);
+	public:
+		static void unlink(const std::string& name);
+	public:
+		void add_sender(waiter* w);
+		void add_receiver(waiter* w);
+	public:
+		bool remove_sender(waiter* w);
+		bool remove_receiver(waiter* w);
+	public:
+		void lock(void);
+		void unlock(void);
+	public:
+		bool peek(void* data);
+		bool poke(void* data);
+	private:
+		static std::size_t segment_size(const std::size_t& capacity);
+		static header* setup(shm_segment& segment, const std::size_t& capacity);
+	private:
+		bool dispatch(const T& data,
+			const std::chrono::steady_clock::time_point* deadline);
+		result<T> receive(
+			const std::chrono::steady_clock::time_point* deadline);
+		bool sleep(const std::uint32_t& state,
+			const std::chrono::steady_clock::time_point* deadline);
+		void notify(void);
+		void unblock(void);
+		void watch(void);
+	};
+
+	template <class T>
+	std::size_t shm_channel<T>::segment_size(const std::size_t& capacity)
+	{
+		return sizeof(header) + capacity * sizeof(ring_cell<T, std::uint64_t>);
+	}
+
+	// the creator sets the header up before the ring sets its cells up,
+	// and publishes both through magic at the end of the constructor
+	template <class T>
+	typename shm_channel<T>::header* shm_channel<T>::setup(
+		shm_segment& segment, const std::size_t& capacity)
+	{
+		header* h = static_cast<header*>(segment.address());
+		if (segment.created())
+		{
+			new (h) header;
+			h->element_size = sizeof(T);
+			h->capacity = capacity;
+			h->state.store(0, std::memory_order_relaxed);
+			h->sleepers.store(0, std::memory_order_relaxed);
+			h->closed.store(0, std::memory_order_relaxed);
+		}
+		return h;
+	}
+
+	// the size is rounded up to a power of two, as for channel<T>; the
+	// others wait for magic before they touch anything else
+	template <class T>
+	shm_channel<T>::shm_channel(const std::string& name, int size)
+		: segment_(name, segment_size(ceil_pow2(size < 1 ? 1 : size)))
+		, header_(setup(segment_, ceil_pow2(size < 1 ? 1 : size)))
+		, ring_(static_cast<void*>(header_ + 1), ceil_pow2(size < 1 ? 1 : size),
+			header_->enqueue_pos, header_->dequeue_pos, segment_.created())
+		, stop_(false)
+	{
+		if (segment_.created())
+			header_->magic.store(ready, std::memory_order_release);
+		else
+		{
+			while (header_->magic.load(std::memory_order_acquire) != ready)
+				std::this_thread::yield();
+			if (header_->element_size != sizeof(T) ||
+					header_->capacity != ring_.capacity())
+				throw std::runtime_error("shm channel has a different layout");
+		}
+	}
+
+	template <class T>
+	shm_channel<T>::~shm_channel(void)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+		}
+		cond_.notify_all();
+		if (watcher_.joinable())
+		{
+			header_->state.fetch_add(1);
+			futex_wake(header_->state, INT_MAX);
+			watcher_.join();
+		}
+	}
+
+	template <class T>
+	std::size_t shm_channel<T>::capacity(void) const
+	{
+		return ring_.capacity();
+	}
+
+	template <class T>
+	std::size_t shm_channel<T>::size(void) const
+	{
+		return ring_.size();
+	}
+
+	template <class T>
+	bool shm_channel<T>::empty(void) const
+	{
+		return ring_.empty();
+	}
+
+	template <class T>
+	bool shm_channel<T>::send(const T& data, const bool& block)
+	{
+		if (!block)
+		{
+			if (header_->closed.load())
+				throw std::runtime_error("send on closed channel");
+			if (!ring_.try_push(data))
+				return false;
+			notify();
+			return true;
+		}
+		return dispatch(data, nullptr);
+	}
+
+	template <class T>
+	bool shm_channel<T>::send_until(const T& data,
+		const std::chrono::steady_clock::time_point& deadline)
+	{
+		return dispatch(data, &deadline);
+	}
+
+	template <class T>
+	bool shm_channel<T>::send_for(const T& data,
+		const std::chrono::steady_clock::duration& timeout)
+	{
+		return send_until(data, std::chrono::steady_clock::now() + timeout);
+	}
+
+	template <class T>
+	result<T> shm_channel<T>::recv(const bool& block)
+	{
+		if (!block)
+		{
+			T data;
+			if (ring_.try_pop(data))
+			{
+				notify();
+				return result<T>(data, true);
+			}
+			if (header_->closed.load())
+				return result<T>(T(), true);	// as channel<T>
+			return result<T>(T(), false);
+		}
+		return receive(nullptr);
+	}
+
+	template <class T>
+	result<T> shm_channel<T>::recv_until(
+		const std::chrono::steady_clock::time_point& deadline)
+	{
+		return receive(&deadline);
+	}
+
+	template <class T>
+	result<T> shm_channel<T>::recv_for(
+		const std::chrono::steady_clock::duration& timeout)
+	{
+		return recv_until(std::chrono::steady_clock::now() + timeout);
+	}
+
+	template <class T>
+	void shm_channel<T>::close(void)
+	{
+		if (header_->closed.exchange(1) == 0)
+		{
+			header_->state.fetch_add(1);
+			futex_wake(header_->state, INT_MAX);
+		}
+	}
+
+	template <class T>
+	void shm_channel<T>::unlink(const std::string& name)
+	{
+		shm_segment::unlink(name);
+	}
+
+	// local waiters are served by the watcher; the first one starts it,
+	// and every one gets a look at the ring right away
+	template <class T>
+	void shm_channel<T>::add_sender(waiter* w)
+	{
+		sendq_.push_back(w);
+		if (!watcher_.joinable())
+			watcher_ = std::thread(&shm_channel<T>::watch, this);
+		cond_.notify_one();
+		unblock();
+	}
+
+	template <class T>
+	void shm_channel<T>::add_receiver(waiter* w)
+	{
+		recvq_.push_back(w);
+		if (!watcher_.joinable())
+			watcher_ = std::thread(&shm_channel<T>::watch, this);
+		cond_.notify_one();
+		unblock();
+	}
+
+	template <class T>
+	bool shm_channel<T>::remove_sender(waiter* w)
+	{
+		return sendq_.remove(w);
+	}
+
+	template <class T>
+	bool shm_channel<T>::remove_receiver(waiter* w)
+	{
+		return recvq_.remove(w);
+	}
+
+	template <class T>
+	void shm_channel<T>::lock(void)
+	{
+		mutex_.lock();
+	}
+
+	template <class T>
+	void shm_channel<T>::unlock(void)
+	{
+		mutex_.unlock();
+	}
+
+	template <class T>
+	bool shm_channel<T>::peek(void* data)
+	{
+		result<T> res = recv(false);
+		if (res.ok)
+			new (data) T(res.data);
+		return res.ok;
+	}
+
+	template <class T>
+	bool shm_channel<T>::poke(void* data)
+	{
+		return send(*static_cast<T*>(data), false);
+	}
+
+	template <class T>
+	bool shm_channel<T>::dispatch(const T& data,
+		const std::chrono::steady_clock::time_point* deadline)
+	{
+		while (true)
+		{
+			if (header_->closed.load())
+				throw std::runtime_error("send on closed channel");
+			if (ring_.try_push(data))
+			{
+				notify();
+				return true;
+			}
+			std::uint32_t state = header_->state.load();
+			header_->sleepers.fetch_add(1);
+			if (!header_->closed.load() && ring_.try_push(data))
+			{
+				header_->sleepers.fetch_sub(1);
+				notify();
+				return true;
+			}
+			bool woken = header_->closed.load() || sleep(state, deadline);
+			header_->sleepers.fetch_sub(1);
+			if (!woken)
+				return false;
+		}
+	}
+
+	template <class T>
+	result<T> shm_channel<T>::receive(
+		const std::chrono::steady_clock::time_point* deadline)
+	{
+		while (true)
+		{
+			T data;
+			if (ring_.try_pop(data))
+			{
+				notify();
+				return result<T>(data, true);
+			}
+			if (header_->closed.load())
+				return result<T>(T(), true);	// as channel<T>
+			std::uint32_t state = header_->state.load();
+			header_->sleepers.fetch_add(1);
+			if (ring_.try_pop(data))
+			{
+				header_->sleepers.fetch_sub(1);
+				notify();
+				return result<T>(data, true);
+			}
+			bool woken = header_->closed.load() || sleep(state, deadline);
+			header_->sleepers.fetch_sub(1);
+			if (!woken)
+				return result<T>(T(), false);
+		}
+	}
+
+	// the sleeper has registered and looked at the ring after reading
+	// state, so any change since makes the futex return at once
+	template <class T>
+	bool shm_channel<T>::sleep(const std::uint32_t& state,
+		const std::chrono::steady_clock::time_point* deadline)
+	{
+		if (deadline == nullptr)
+		{
+			futex_wait(header_->state, state);
+			return true;
+		}
+		return futex_wait_until(header_->state, state, *deadline);
+	}
+
+	template <class T>
+	void shm_channel<T>::notify(void)
+	{
+		header_->state.fetch_add(1);
+		if (header_->sleepers.load() > 0)
+			futex_wake(header_->state, INT_MAX);
+	}
+
+	// with the local lock held, hand values to parked receivers and push
+	// the values of parked senders; a claimed waiter that loses out to
+	// another process, or finds the channel closed, is woken to retry
+	template <class T>
+	void shm_channel<T>::unblock(void)
+	{
+		bool closed = header_->closed.load() != 0;
+		while (!recvq_.empty() && (closed || !empty()))
+		{
+			waiter* w = recvq_.pop_front();
+			if (!w->ctext->claim())
+				continue;
+			T data;
+			if (ring_.try_pop(data))
+			{
+				new (w->ctext->unblocked_receiver(w)) T(data);
+				notify();
+			}
+			w->ctext->signal();
+		}
+		while (!sendq_.empty() && (closed || size() < capacity()))
+		{
+			waiter* w = sendq_.pop_front();
+			if (!w->ctext->claim())
+				continue;
+			if (!closed && ring_.try_push(*static_cast<T*>(w->data)))
+			{
+				w->ctext->unblocked_sender(w);
+				notify();
+			}
+			w->ctext->signal();
+		}
+	}
+
+	// sleeps on the segment while local contexts are parked on it and on
+	// the condition variable while none are
+	template <class T>
+	void shm_channel<T>::watch(void)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		while (!stop_)
+		{
+			if (recvq_.empty() && sendq_.empty())
+			{
+				cond_.wait(lock);
+				continue;
+			}
+			std::uint32_t state = header_->state.load();
+			header_->sleepers.fetch_add(1);
+			unblock();
+			if (stop_ || (recvq_.empty() && sendq_.empty()))
+			{
+				header_->sleepers.fetch_sub(1);
+				continue;
+			}
+			lock.unlock();
+			futex_wait(header_->state, state);
+			header_->sleepers.fetch_sub(1);
+			lock.lock();
+		}
+	}
+}
+
+#endif
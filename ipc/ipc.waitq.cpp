@@ -0,0 +1,71 @@
+#include "ipc.waitq.h"
+
+ipc::waiter::waiter(ipc::context* ctext, ipc::channable* chan, void* data,
+		const bool& recv, const int& index)
+	: ctext(ctext)
+	, chan(chan)
+	, data(data)
+	, recv(recv)
+	, index(index)
+	, prev(nullptr)
+	, next(nullptr)
+	, queued(false)
+{
+}
+
+ipc::waitq::waitq(void)
+	: head_(nullptr)
+	, tail_(nullptr)
+	, size_(0)
+{
+}
+
+bool ipc::waitq::empty(void) const
+{
+	return head_ == nullptr;
+}
+
+std::size_t ipc::waitq::size(void) const
+{
+	return size_;
+}
+
+void ipc::waitq::push_back(ipc::waiter* w)
+{
+	w->prev = tail_;
+	w->next = nullptr;
+	if (tail_ != nullptr)
+		tail_->next = w;
+	else
+		head_ = w;
+	tail_ = w;
+	w->queued = true;
+	size_++;
+}
+
+ipc::waiter* ipc::waitq::pop_front(void)
+{
+	waiter* w = head_;
+	if (w != nullptr)
+		remove(w);
+	return w;
+}
+
+bool ipc::waitq::remove(ipc::waiter* w)
+{
+	if (!w->queued)
+		return false;
+	if (w->prev != nullptr)
+		w->prev->next = w->next;
+	else
+		head_ = w->next;
+	if (w->next != nullptr)
+		w->next->prev = w->prev;
+	else
+		tail_ = w->prev;
+	w->prev = nullptr;
+	w->next = nullptr;
+	w->queued = false;
+	size_--;
+	return true;
+}
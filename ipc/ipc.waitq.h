@@ -0,0 +1,47 @@
+#ifndef __IPC_WAITQ__
+#define __IPC_WAITQ__
+
+#include <cstddef>
+
+namespace ipc
+{
+	class context;
+	struct channable;
+
+	// one node per case a context is parked on, linked straight into the
+	// channel's queue; data points at the value a sender offers or at the
+	// storage a receiver wants its value constructed in
+	struct waiter
+	{
+		context* ctext;
+		channable* chan;
+		void* data;
+		bool recv;
+		int index;
+		waiter* prev;
+		waiter* next;
+		bool queued;
+	public:
+		waiter(context* ctext, channable* chan, void* data,
+			const bool& recv, const int& index);
+	};
+
+	// intrusive fifo of wait nodes, O(1) to enqueue, dequeue or cancel
+	class waitq
+	{
+		waiter* head_;
+		waiter* tail_;
+		std::size_t size_;
+	public:
+		waitq(void);
+	public:
+		bool empty(void) const;
+		std::size_t size(void) const;
+	public:
+		void push_back(waiter* w);
+		waiter* pop_front(void);
+		bool remove(waiter* w);
+	};
+}
+
+#endif
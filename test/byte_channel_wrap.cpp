@@ -0,0 +1,85 @@
+// frames of every size from 0 to max_frame through a small byte_channel
+// while the receiver runs, so that large frames keep forcing a pad at the
+// end of the ring with the receiver reading right behind it; every frame
+// must arrive whole, in order and with its own size. exits non zero on
+// the first frame that does not
+//
+//   g++ -std=c++17 -O2 -pthread -I../ipc ../ipc/*.cpp byte_channel_wrap.cpp -o byte_channel_wrap
+
+#include "ipc.h"
+
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	const std::size_t frames = 200000;
+
+	// a size that jumps between small and near max_frame, so that most
+	// large frames find too little room before the end of the ring
+	std::size_t size_of(const std::size_t& i, const std::size_t& max)
+	{
+		return i % 3 == 0 ? max - i % 16 : (i * 37) % (max + 1);
+	}
+
+	unsigned char byte_of(const std::size_t& i, const std::size_t& k)
+	{
+		return static_cast<unsigned char>(i * 131 + k);
+	}
+
+	bool run(const std::size_t& capacity)
+	{
+		ipc::byte_channel ch(capacity);
+		std::size_t max = ch.max_frame();
+		std::thread sender([&ch, max](void) {
+			std::vector<unsigned char> frame(max);
+			for (std::size_t i = 0; i < frames; i++)
+			{
+				std::size_t size = size_of(i, max);
+				for (std::size_t k = 0; k < size; k++)
+					frame[k] = byte_of(i, k);
+				ch.send(frame.data(), size);
+			}
+			ch.close();
+		});
+		bool ok = true;
+		std::size_t i = 0;
+		while (ok)
+		{
+			ipc::result<ipc::byte_span> r = ch.recv();
+			if (r.data.data == nullptr)
+				break;
+			const unsigned char* p =
+				static_cast<const unsigned char*>(r.data.data);
+			if (i >= frames || r.data.size != size_of(i, max))
+				ok = false;
+			for (std::size_t k = 0; ok && k < r.data.size; k++)
+				if (p[k] != byte_of(i, k))
+					ok = false;
+			if (!ok)
+				std::printf("capacity %zu: frame %zu of %zu bytes is wrong\n",
+					capacity, i, r.data.size);
+			ch.release();
+			i++;
+		}
+		sender.join();
+		if (ok && i != frames)
+		{
+			std::printf("capacity %zu: %zu of %zu frames arrived\n",
+				capacity, i, frames);
+			ok = false;
+		}
+		return ok;
+	}
+}
+
+int main(void)
+{
+	bool ok = true;
+	for (std::size_t capacity: { 64, 256, 4096 })
+		ok = run(capacity) && ok;
+	std::printf(ok ? "ok\n" : "failed\n");
+	return ok ? 0 : 1;
+}